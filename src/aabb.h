@@ -13,9 +13,9 @@ struct AABB {
           y(iy),
           z(iz) {}
     AABB(const Point3& a, const Point3& b) {
-        x = Interval(fmin(a.x, b.x), fmax(a.x, b.x));
-        y = Interval(fmin(a.y, b.y), fmax(a.y, b.y));
-        z = Interval(fmin(a.z, b.z), fmax(a.z, b.z));
+        x = Interval(std::fmin(a.x, b.x), std::fmax(a.x, b.x));
+        y = Interval(std::fmin(a.y, b.y), std::fmax(a.y, b.y));
+        z = Interval(std::fmin(a.z, b.z), std::fmax(a.z, b.z));
     }
     AABB(const AABB& box0, const AABB& box1) {
         x = Interval(box0.x, box1.x);
@@ -25,7 +25,7 @@ struct AABB {
 
     AABB pad() {
         // 确保包围盒的三维间距大于零
-        double delta = 0.0001;
+        Real delta = 0.0001;
         Interval new_x = (x.size() >= delta) ? x : x.expand(delta);
         Interval new_y = (y.size() >= delta) ? y : y.expand(delta);
         Interval new_z = (z.size() >= delta) ? z : z.expand(delta);
@@ -33,6 +33,11 @@ struct AABB {
         return AABB(new_x, new_y, new_z);
     }
 
+    Real surface_area() const {
+        return 2 * (x.size() * y.size() + y.size() * z.size() +
+                    z.size() * x.size());
+    }
+
     const Interval& axis(int n) const {
         if (n == 1) return y;
         if (n == 2) return z;
@@ -40,8 +45,14 @@ struct AABB {
     }
 
     bool hit(const Ray& ray, Interval interval) const {
+        return hit(ray, Vec3(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z),
+                   interval);
+    }
+
+    // inv_dir为光线方向各分量的倒数，遍历BVH时每条光线只需计算一次
+    bool hit(const Ray& ray, const Vec3& inv_dir, Interval interval) const {
         for (int n = 0; n < 3; ++n) {
-            auto invD = 1 / ray.dir[n];
+            auto invD = inv_dir[n];
             auto orig = ray.origin[n];
 
             auto t0 = (axis(n).min - orig) * invD;
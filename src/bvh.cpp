@@ -1,4 +1,5 @@
 #include "bvh.h"
+#include <algorithm>
 
 namespace cray {
 
@@ -24,8 +25,28 @@ bool box_compare_z(const std::shared_ptr<Hittable> a,
 }
 
 BVHNode::BVHNode(const std::vector<std::shared_ptr<Hittable>>& objs,
-                 size_t index_start, size_t index_end) {
-    auto copy_objs = objs;
+                 size_t index_start, size_t index_end, bool motion_bounds)
+    : motion_bounds_(motion_bounds) {
+    std::vector<std::shared_ptr<Hittable>> copy_objs;
+    for (size_t i = index_start; i < index_end; ++i) {
+        if (objs[i]->is_bounded())
+            copy_objs.push_back(objs[i]);
+        else
+            unbounded_.push_back(objs[i]);
+    }
+    if (copy_objs.empty()) {
+        nodes_.push_back(Node{AABB(), 0, 0, true});
+        return;
+    }
+    build(copy_objs, 0, copy_objs.size());
+    build_cost_ = sah_cost();
+    update_motion_bounds();
+}
+
+uint32_t BVHNode::build(std::vector<std::shared_ptr<Hittable>>& objs,
+                        size_t index_start, size_t index_end) {
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
 
     int axis = random_int(0, 2);
 
@@ -35,37 +56,275 @@ BVHNode::BVHNode(const std::vector<std::shared_ptr<Hittable>>& objs,
 
     size_t objs_num = index_end - index_start;
 
-    if (objs_num == 1) {
-        left = right = copy_objs[index_start];
-    } else if (objs_num == 2) {
-        if (comparator(copy_objs[index_start], copy_objs[index_start + 1])) {
-            left = copy_objs[index_start];
-            right = copy_objs[index_start + 1];
+    if (objs_num <= 2) {
+        if (objs_num == 2 &&
+            !comparator(objs[index_start], objs[index_start + 1])) {
+            std::swap(objs[index_start], objs[index_start + 1]);
+        }
+
+        Node leaf{AABB(), static_cast<uint32_t>(refs_.size()), 0, true};
+        for (size_t i = index_start; i < index_end; ++i) {
+            leaf.aabb = AABB(leaf.aabb, objs[i]->bounding_box());
+            primitives_.add(objs[i], refs_);
+        }
+        leaf.count = static_cast<uint32_t>(refs_.size()) - leaf.offset;
+        nodes_[index] = leaf;
+        return index;
+    }
+
+    std::sort(objs.begin() + index_start, objs.begin() + index_end,
+              comparator);
+    size_t mid = index_start + objs_num / 2;
+    build(objs, index_start, mid);
+    auto right = build(objs, mid, index_end);
+
+    nodes_[index] = Node{AABB(nodes_[index + 1].aabb, nodes_[right].aabb),
+                         right, 0, false};
+    return index;
+}
+
+void BVHNode::refit() {
+    // 子节点的下标总是大于父节点，逆序遍历即为自底向上
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        auto& node = nodes_[i];
+        if (node.leaf) {
+            AABB aabb;
+            for (uint32_t j = node.offset; j < node.offset + node.count; ++j) {
+                aabb = AABB(aabb, primitives_.bounding_box(refs_[j]));
+            }
+            node.aabb = aabb;
+        } else {
+            node.aabb = AABB(nodes_[i + 1].aabb, nodes_[node.offset].aabb);
+        }
+    }
+    update_motion_bounds();
+}
+
+void BVHNode::update_motion_bounds() {
+    if (!motion_bounds_) return;
+
+    motion_.resize(nodes_.size());
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        const auto& node = nodes_[i];
+        auto& bounds = motion_[i];
+        if (node.leaf) {
+            bounds = MotionBounds();
+            for (uint32_t j = node.offset; j < node.offset + node.count; ++j) {
+                auto ref = refs_[j];
+                bounds.aabb0 = AABB(bounds.aabb0,
+                                    primitives_.bounding_box_at(ref, 0));
+                bounds.aabb1 = AABB(bounds.aabb1,
+                                    primitives_.bounding_box_at(ref, 1));
+            }
         } else {
-            left = copy_objs[index_start + 1];
-            right = copy_objs[index_start];
+            const auto& left = motion_[i + 1];
+            const auto& right = motion_[node.offset];
+            bounds.aabb0 = AABB(left.aabb0, right.aabb0);
+            bounds.aabb1 = AABB(left.aabb1, right.aabb1);
         }
-    } else {
-        std::sort(copy_objs.begin() + index_start,
-                  copy_objs.begin() + index_end, comparator);
-        size_t mid = index_start + objs_num / 2;
-        left = std::make_shared<BVHNode>(objs, index_start, mid);
-        right = std::make_shared<BVHNode>(objs, mid, index_end);
     }
+}
+
+void BVHNode::rebuild() {
+    if (refs_.empty()) return;
+
+    std::vector<BuildItem> items(refs_.size());
+    for (size_t i = 0; i < refs_.size(); ++i) {
+        auto aabb = primitives_.bounding_box(refs_[i]);
+        items[i] = BuildItem{refs_[i], aabb,
+                             Point3((aabb.x.min + aabb.x.max) / 2,
+                                    (aabb.y.min + aabb.y.max) / 2,
+                                    (aabb.z.min + aabb.z.max) / 2)};
+    }
+
+    nodes_.clear();
+    nodes_.reserve(2 * items.size());
+    build_sah(items, 0, items.size(), 0);
+    for (size_t i = 0; i < items.size(); ++i) refs_[i] = items[i].ref;
 
-    aabb = AABB(left->bounding_box(), right->bounding_box());
+    build_cost_ = sah_cost();
+    update_motion_bounds();
+}
+
+bool BVHNode::update(Real rebuild_threshold) {
+    refit();
+    if (sah_cost() <= rebuild_threshold * build_cost_) return false;
+    rebuild();
+    return true;
+}
+
+Real BVHNode::sah_cost() const {
+    auto root_area = nodes_[0].aabb.surface_area();
+    if (!(root_area > 0)) return 0;
+
+    Real cost = 0;
+    for (const auto& node : nodes_) {
+        cost += node.aabb.surface_area() * (node.leaf ? node.count : 1);
+    }
+    return cost / root_area;
+}
+
+uint32_t BVHNode::build_sah(std::vector<BuildItem>& items, size_t begin,
+                            size_t end, int depth) {
+    const int BinCount = 12;
+
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    AABB bounds, centroids;
+    for (size_t i = begin; i < end; ++i) {
+        bounds = AABB(bounds, items[i].aabb);
+        centroids =
+            AABB(centroids, AABB(items[i].centroid, items[i].centroid));
+    }
+
+    auto make_leaf = [&] {
+        nodes_[index] = Node{bounds, static_cast<uint32_t>(begin),
+                             static_cast<uint32_t>(end - begin), true};
+        return index;
+    };
+
+    size_t count = end - begin;
+    int axis = 0;
+    for (int n = 1; n < 3; ++n) {
+        if (centroids.axis(n).size() > centroids.axis(axis).size()) axis = n;
+    }
+    auto extent = centroids.axis(axis);
+    if (count <= 2 || !(extent.size() > 0)) return make_leaf();
+
+    // 过深时改为按数量中位数划分，保证遍历栈不会溢出
+    if (depth >= MaxSahDepth) {
+        size_t mid = begin + count / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid,
+                         items.begin() + end,
+                         [axis](const BuildItem& a, const BuildItem& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+        build_sah(items, begin, mid, depth + 1);
+        auto right_child = build_sah(items, mid, end, depth + 1);
+        nodes_[index] = Node{bounds, right_child, 0, false};
+        return index;
+    }
+
+    // 沿中心分布最长的轴分桶，选SAH代价最小的划分位置
+    struct Bin {
+        AABB aabb;
+        size_t count = 0;
+    } bins[BinCount];
+    auto bin_of = [&](const BuildItem& item) {
+        int b = static_cast<int>(BinCount * (item.centroid[axis] - extent.min) /
+                                 extent.size());
+        return std::min(b, BinCount - 1);
+    };
+    for (size_t i = begin; i < end; ++i) {
+        auto& bin = bins[bin_of(items[i])];
+        bin.aabb = AABB(bin.aabb, items[i].aabb);
+        bin.count++;
+    }
+
+    Real right_area[BinCount];
+    size_t right_count[BinCount];
+    AABB right;
+    size_t n = 0;
+    for (int b = BinCount - 1; b > 0; --b) {
+        right = AABB(right, bins[b].aabb);
+        n += bins[b].count;
+        right_area[b] = right.surface_area();
+        right_count[b] = n;
+    }
+
+    int best_split = 1;
+    Real best_cost = Infinity;
+    AABB left;
+    n = 0;
+    for (int b = 1; b < BinCount; ++b) {
+        left = AABB(left, bins[b - 1].aabb);
+        n += bins[b - 1].count;
+        if (n == 0 || right_count[b] == 0) continue;
+        auto cost = left.surface_area() * n + right_area[b] * right_count[b];
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_split = b;
+        }
+    }
+
+    // 相对代价：一次遍历 + 两侧求交；不划分更便宜时生成叶节点
+    auto leaf_cost = static_cast<Real>(count);
+    auto split_cost = 1 + best_cost / bounds.surface_area();
+    if (count <= 4 && leaf_cost <= split_cost) return make_leaf();
+
+    size_t mid = std::partition(items.begin() + begin, items.begin() + end,
+                                [&](const BuildItem& item) {
+                                    return bin_of(item) < best_split;
+                                }) -
+                 items.begin();
+    if (mid == begin || mid == end) mid = begin + count / 2;
+
+    build_sah(items, begin, mid, depth + 1);
+    auto right_child = build_sah(items, mid, end, depth + 1);
+    nodes_[index] = Node{bounds, right_child, 0, false};
+    return index;
+}
+
+bool BVHNode::hit_motion_bounds(uint32_t index, const Ray& ray,
+                                const Vec3& inv_dir,
+                                const Interval& interval) const {
+    const auto& m = motion_[index];
+    auto lerp = [t = ray.tm](const Interval& a, const Interval& b) {
+        return Interval(a.min + t * (b.min - a.min),
+                        a.max + t * (b.max - a.max));
+    };
+    AABB aabb(lerp(m.aabb0.x, m.aabb1.x), lerp(m.aabb0.y, m.aabb1.y),
+              lerp(m.aabb0.z, m.aabb1.z));
+    return aabb.hit(ray, inv_dir, interval);
 }
 
 bool BVHNode::hit(const Ray& ray, const Interval& interval,
                   HitRecord& rec) const {
-    if (!aabb.hit(ray, interval)) return false;
+    // 构造时的中位数划分是平衡的；SAH构建超过MaxSahDepth层后也改为
+    // 中位数划分，图元少于2^23个时树深不超过63，64层的栈足够
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    Vec3 inv_dir(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z);
+    bool motion = !motion_.empty();
+    bool hit_anything = false;
+    auto closest_so_far = interval.max;
 
-    // 计算左右叶节点的命中情况
-    bool left_hit = left->hit(ray, interval, rec);
-    bool right_hit = right->hit(
-        ray, Interval(interval.min, left_hit ? rec.t : interval.max), rec);
+    // 先求交无界物体，得到的交点可以剔除更多节点
+    for (const auto& obj : unbounded_) {
+        if (obj->hit(ray, Interval(interval.min, closest_so_far), rec)) {
+            hit_anything = true;
+            closest_so_far = rec.t;
+        }
+    }
+
+    while (stack_size > 0) {
+        auto index = stack[--stack_size];
+        const auto& node = nodes_[index];
+        Interval ray_t(interval.min, closest_so_far);
+        if (motion ? !hit_motion_bounds(index, ray, inv_dir, ray_t)
+                   : !node.aabb.hit(ray, inv_dir, ray_t))
+            continue;
+
+        if (node.leaf) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (primitives_.hit(refs_[i], ray,
+                                    Interval(interval.min, closest_so_far),
+                                    rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+        } else {
+            // 先访问左子节点
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = index + 1;
+        }
+    }
 
-    return left_hit || right_hit;
+    return hit_anything;
 }
 
 }  // namespace cray
\ No newline at end of file
@@ -1,24 +1,90 @@
 #pragma once
 
 #include "hittable_list.h"
+#include "primitive.h"
 
 namespace cray {
 
+// 展平存储的BVH，叶节点引用PrimitiveStore中的图元
 class BVHNode : public Hittable {
 public:
-    BVHNode(const HittableList& list)
-        : BVHNode(list.objects, 0, list.objects.size()) {}
+    // motion_bounds为true时每个节点额外保存t=0与t=1的包围盒，
+    // 遍历时按ray.tm插值，运动模糊场景中比整个运动范围的包围盒更紧
+    BVHNode(const HittableList& list, bool motion_bounds = false)
+        : BVHNode(list.objects, 0, list.objects.size(), motion_bounds) {}
     BVHNode(const std::vector<std::shared_ptr<Hittable>>& objs,
-            size_t index_start, size_t index_end);
+            size_t index_start, size_t index_end, bool motion_bounds = false);
 
     bool hit(const Ray& ray, const Interval& interval,
              HitRecord& rec) const override;
 
-    AABB bounding_box() const override { return aabb; }
+    // 有界部分的包围盒
+    AABB bounding_box() const override { return nodes_[0].aabb; }
 
-    std::shared_ptr<Hittable> left;
-    std::shared_ptr<Hittable> right;
-    AABB aabb;
+    bool is_bounded() const override { return unbounded_.empty(); }
+
+    // 修改图元位置后自底向上更新包围盒，树的拓扑不变
+    void refit();
+    // 按当前图元位置用binned SAH重新构建整棵树
+    void rebuild();
+    // refit，若SAH代价超过上次构建时的rebuild_threshold倍则rebuild。
+    // 返回是否进行了rebuild
+    bool update(Real rebuild_threshold = 1.5);
+
+    // 以根节点表面积归一化的SAH代价(遍历与求交代价都记为1)
+    Real sah_cost() const;
+    Real build_sah_cost() const { return build_cost_; }
+
+    PrimitiveStore& primitives() { return primitives_; }
+
+    // 节点与按值存放的图元占用的内存，不含材质
+    size_t memory_bytes() const {
+        return sizeof(*this) + nodes_.capacity() * sizeof(Node) +
+               motion_.capacity() * sizeof(MotionBounds) +
+               refs_.capacity() * sizeof(PrimitiveRef) +
+               unbounded_.capacity() * sizeof(std::shared_ptr<Hittable>) +
+               primitives_.memory_bytes();
+    }
+
+private:
+    struct Node {
+        AABB aabb;
+        // 内部节点：右子节点的下标，左子节点紧跟在当前节点之后；
+        // 叶节点：refs_中第一个图元引用的位置
+        uint32_t offset;
+        uint32_t count;  // 叶节点的图元引用数
+        bool leaf;
+    };
+
+    uint32_t build(std::vector<std::shared_ptr<Hittable>>& objs,
+                   size_t index_start, size_t index_end);
+    struct MotionBounds {
+        AABB aabb0;  // t=0
+        AABB aabb1;  // t=1
+    };
+
+    struct BuildItem {
+        PrimitiveRef ref;
+        AABB aabb;
+        Point3 centroid;
+    };
+    static const int MaxSahDepth = 40;
+    uint32_t build_sah(std::vector<BuildItem>& items, size_t begin,
+                       size_t end, int depth);
+    void update_motion_bounds();
+
+    // 按ray.tm插值两个时刻的包围盒后求交
+    bool hit_motion_bounds(uint32_t index, const Ray& ray, const Vec3& inv_dir,
+                           const Interval& interval) const;
+
+    std::vector<Node> nodes_;
+    std::vector<MotionBounds> motion_;  // 与nodes_一一对应，未开启时为空
+    bool motion_bounds_;
+    std::vector<PrimitiveRef> refs_;
+    PrimitiveStore primitives_;
+    // 无界物体不参与构建，每条光线在遍历前单独求交
+    std::vector<std::shared_ptr<Hittable>> unbounded_;
+    Real build_cost_ = 0;
 };
 
-}  // namespace cray
\ No newline at end of file
+}  // namespace cray
@@ -1,56 +1,165 @@
 #include "camera.h"
-#include "material.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
-#include <fstream>
-#include "stb_image_write.h"
+#include <thread>
+#include "checkpoint.h"
+#include "material.h"
+#include "tone_map.h"
 
 namespace cray {
 
-double linear_to_gamma(double linear_comp) { return sqrt(linear_comp); }
+void Camera::render(const Hittable& world, Film& film) {
+    init();
 
-// void write_color(std::ostream& out, Color pixel_color, double scale) {
-//     static const Interval cl(0.000, 0.999);
+    film = Film(image_width, image_height);
+
+    int start_sample = 0;
+    if (!checkpoint_path.empty()) start_sample = resume(film);
+
+    using Clock = std::chrono::steady_clock;
+    auto seconds_since = [](Clock::time_point t) {
+        return std::chrono::duration<double>(Clock::now() - t).count();
+    };
+
+    auto render_start = Clock::now();
+    auto last_checkpoint = render_start;
+    double checkpoint_seconds = 0.0;
+    int checkpoint_count = 0;
+
+    // 按采样序号逐pass渲染，每个pass结束时所有像素的采样数相同。
+    // pass的采样数等于本次已渲染的采样数，总数按1, 2, 4, ...翻倍
+    int sample = start_sample;
+    while (sample < samples_per_pixel) {
+        int end = std::min(samples_per_pixel,
+                           sample + std::max(1, sample - start_sample));
+        if (sample > start_sample) {
+            auto elapsed = seconds_since(render_start);
+            auto sample_seconds = elapsed / (sample - start_sample);
+            auto samples_in = [&](double seconds) {
+                return static_cast<int>(std::min<double>(
+                    seconds / sample_seconds, samples_per_pixel));
+            };
+            // 剩余时间不够渲染完整个pass时缩短它，一个采样也不够时提前结束
+            if (time_budget > 0) {
+                int fit = samples_in(time_budget - elapsed);
+                if (fit < 1) break;
+                end = std::min(end, sample + fit);
+            }
+            // pass不跨过下一次checkpoint的时间，保持写入间隔
+            if (!checkpoint_path.empty()) {
+                int fit = samples_in(checkpoint_interval -
+                                     seconds_since(last_checkpoint));
+                end = std::min(end, sample + std::max(1, fit));
+            }
+        }
+
+        render_region(world, film,
+                      RenderTask{0, 0, image_width, image_height, sample, end},
+                      0, 0);
+        sample = end;
+
+        if (!preview_path.empty() && sample < samples_per_pixel) {
+            save_image(film, preview_path);
+            std::clog << "preview: " << sample << " spp after "
+                      << seconds_since(render_start) << " s\n";
+        }
 
-//     auto r = linear_to_gamma(pixel_color.r * scale);
-//     auto g = linear_to_gamma(pixel_color.g * scale);
-//     auto b = linear_to_gamma(pixel_color.b * scale);
+        if (!checkpoint_path.empty() && sample < samples_per_pixel &&
+            seconds_since(last_checkpoint) >= checkpoint_interval) {
+            auto write_start = Clock::now();
+            save_checkpoint(film, sample);
+            last_checkpoint = Clock::now();
+            checkpoint_seconds += seconds_since(write_start);
+            checkpoint_count++;
+        }
+    }
 
-//     out << static_cast<int>(255.999 * cl.clamp(r)) << ' '
-//         << static_cast<int>(255.999 * cl.clamp(g)) << ' '
-//         << static_cast<int>(255.999 * cl.clamp(b)) << '\n';
-// }
+    if (checkpoint_count > 0) {
+        auto total = seconds_since(render_start);
+        std::clog << "checkpoint: " << checkpoint_count << " writes, "
+                  << checkpoint_seconds * 1000.0 << " ms ("
+                  << 100.0 * checkpoint_seconds / total << "% of render)\n";
+    }
 
-uint8_t final_color(double c, double scale) {
-    static const Interval cl(0.000, 0.999);
+    if (sample < samples_per_pixel) {
+        std::clog << "time budget reached at " << sample << " spp\n";
+        // 保留断点，之后可以继续渲染到samples_per_pixel
+        if (!checkpoint_path.empty()) save_checkpoint(film, sample);
+    } else if (!checkpoint_path.empty()) {
+        // 渲染完成后断点不再需要
+        std::remove(checkpoint_path.c_str());
+    }
+}
 
-    auto r = linear_to_gamma(c * scale);
-    return static_cast<int>(255.999 * cl.clamp(r));
+void Camera::save_checkpoint(const Film& film, int next_sample) const {
+    Checkpoint ckpt{next_sample, seed, film};
+    if (!write_checkpoint(ckpt, checkpoint_path)) {
+        std::clog << "failed to write checkpoint " << checkpoint_path << '\n';
+    }
 }
 
-void Camera::render_to_png(const Hittable& world, const char* file_name) {
-    init();
+int Camera::resume(Film& film) const {
+    Checkpoint ckpt;
+    if (!read_checkpoint(ckpt, checkpoint_path)) return 0;
 
-    uint8_t* pixels = new uint8_t[image_width * image_height * 3];
-    int index = 0;
+    if (ckpt.film.width() != image_width ||
+        ckpt.film.height() != image_height ||
+        ckpt.next_sample > samples_per_pixel || ckpt.seed != seed) {
+        std::clog << "ignore mismatched checkpoint " << checkpoint_path
+                  << '\n';
+        return 0;
+    }
 
-    const auto scale = 1.0 / samples_per_pixel;
+    film = std::move(ckpt.film);
+    std::clog << "resume from sample " << ckpt.next_sample << '\n';
+    return ckpt.next_sample;
+}
 
-    for (int j = 0; j < image_height; ++j) {
-        for (int i = 0; i < image_width; ++i) {
-            Color pixel_color(0, 0, 0);
-            for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                auto ray = get_ray(i, j);
-                pixel_color += ray_color(ray, world, max_depth);
+void Camera::render_region(const Hittable& world, Film& film,
+                           const RenderTask& task, int film_x0,
+                           int film_y0) const {
+    // 按行动态分配给各线程。每个像素采样的随机数只取决于
+    // (像素, 采样序号, seed)，与线程数和行的分配顺序无关
+    std::atomic<int> next_row(task.y0);
+    auto worker = [&]() {
+        auto sampler = create_sampler(sampler_type, samples_per_pixel, seed);
+        for (int j = next_row++; j < task.y1; j = next_row++) {
+            for (int i = task.x0; i < task.x1; ++i) {
+                for (int s = task.sample_begin; s < task.sample_end; ++s) {
+                    sampler->start_pixel_sample(i, j, s);
+                    auto ray = get_ray(i, j, *sampler);
+                    film.add_sample(i - film_x0, j - film_y0,
+                                    ray_color(ray, world, max_depth, *sampler));
+                }
             }
-            pixels[index] = final_color(pixel_color.r, scale);
-            pixels[index + 1] = final_color(pixel_color.g, scale);
-            pixels[index + 2] = final_color(pixel_color.b, scale);
-            index += 3;
         }
-    }
+    };
+
+    int thread_count = threads;
+    if (thread_count <= 0)
+        thread_count = static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = std::max(1, std::min(thread_count, task.y1 - task.y0));
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < thread_count; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+Film Camera::render_tile(const Hittable& world, const RenderTask& task) const {
+    Film tile(task.x1 - task.x0, task.y1 - task.y0);
+    render_region(world, tile, task, task.x0, task.y0);
+    return tile;
+}
+
+void Camera::render_to_png(const Hittable& world, const char* file_name) {
+    Film film;
+    render(world, film);
 
-    stbi_write_png(file_name, image_width, image_height, 3, pixels,
-                   image_width * 3);
+    write_png(tone_map(film), film.width(), film.height(), file_name);
 }
 
 void Camera::init() {
@@ -82,14 +191,24 @@ void Camera::init() {
         center - focus_dist * w - viewport_u / 2 - viewport_v / 2;
     pixel00_loc = viewport_upper_left + 0.5f * (pixel_delta_u + pixel_delta_v);
 
+    // 多次采样本身也在像素内积分，每次采样的足迹只需覆盖1/sqrt(spp)个像素
+    differential_scale =
+        1 / std::sqrt(static_cast<Real>(std::max(1, samples_per_pixel)));
+
     auto defocus_radius =
         focus_dist * tan(degrees_to_radians(defocus_angle / 2));
     defocus_disk_u = u * defocus_radius;
     defocus_disk_v = v * defocus_radius;
 }
 
-Color Camera::ray_color(const Ray& ray, const Hittable& world,
-                        int depth) const {
+// 幂启发式(β=2)的MIS权重
+static Real power_heuristic(Real pdf, Real other_pdf) {
+    auto a = pdf * pdf, b = other_pdf * other_pdf;
+    return a / (a + b);
+}
+
+Color Camera::ray_color(const Ray& ray, const Hittable& world, int depth,
+                        Sampler& sampler, Real scatter_pdf) const {
     if (depth <= 0) {
         return Color(0, 0, 0);
     }
@@ -97,18 +216,36 @@ Color Camera::ray_color(const Ray& ray, const Hittable& world,
     HitRecord rec;
 
     if (!world.hit(ray, Interval(0.001, Infinity), rec)) {
-        return background;
+        if (!environment) return background;
+        // 上一个顶点也对环境光采样过，这一方向按两种策略的pdf加权
+        auto radiance = environment->radiance(ray.dir);
+        if (scatter_pdf > 0)
+            radiance *=
+                power_heuristic(scatter_pdf, environment->pdf(ray.dir));
+        return radiance;
     }
+    rec.compute_differentials(ray);
 
     Color attenuation;
     Ray scattered_ray;
 
     Color color_emit = rec.mat->emitted(rec.u, rec.v, rec.p);
 
-    if (!rec.mat->scatter(ray, rec, attenuation, scattered_ray))
+    sampler.start_vertex(max_depth - depth);
+    if (!rec.mat->scatter(ray, rec, sampler, attenuation, scattered_ray))
         return color_emit;
-    Color colo_scatter =
-        attenuation * ray_color(scattered_ray, world, depth - 1);
+
+    // 环境光采样在scatter之后取样本，不改变没有环境光时的维度分配
+    Real pdf = 0;
+    if (environment && environment_mis) {
+        pdf = rec.mat->scattering_pdf(ray, rec,
+                                      unit_vector(scattered_ray.dir));
+        if (pdf > 0)
+            color_emit +=
+                sample_environment(ray, rec, world, sampler, attenuation);
+    }
+    Color colo_scatter = attenuation * ray_color(scattered_ray, world,
+                                                 depth - 1, sampler, pdf);
     return color_emit + colo_scatter;
 
     // 默认的天空盒背景颜色实现
@@ -117,27 +254,56 @@ Color Camera::ray_color(const Ray& ray, const Hittable& world,
     // return (1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
 }
 
-Vec3 Camera::pixel_sample_square() const {
-    auto px = -0.5 + random_double();
-    auto py = -0.5 + random_double();
+Color Camera::sample_environment(const Ray& ray, const HitRecord& rec,
+                                 const Hittable& world, Sampler& sampler,
+                                 const Color& attenuation) const {
+    Vec3 wi;
+    Real light_pdf;
+    auto radiance = environment->sample(sampler.get_2d(), wi, light_pdf);
+    if (!(light_pdf > 0)) return Color(0, 0, 0);
+    auto pdf = rec.mat->scattering_pdf(ray, rec, wi);
+    if (!(pdf > 0)) return Color(0, 0, 0);
+
+    HitRecord shadow;
+    if (world.hit(Ray(rec.p, wi, ray.tm), Interval(0.001, Infinity), shadow))
+        return Color(0, 0, 0);
+    // f*cosθ = attenuation*pdf
+    return attenuation * radiance *
+           (pdf * power_heuristic(light_pdf, pdf) / light_pdf);
+}
+
+Vec3 Camera::pixel_sample_square(const Point2& u) const {
+    auto px = -0.5 + u.x;
+    auto py = -0.5 + u.y;
     return (px * pixel_delta_u) + (py * pixel_delta_v);
 }
 
-Ray Camera::get_ray(int i, int j) const {
+Ray Camera::get_ray(int i, int j, Sampler& sampler) const {
     auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-    auto pixel_sample = pixel_center + pixel_sample_square();
+    auto pixel_sample = pixel_center + pixel_sample_square(sampler.get_2d());
 
-    auto ray_origin = defocus_angle <= 0 ? center : defocus_disk_sample();
+    // 无论是否有景深都占用光圈的两个维度，保证维度分配固定
+    auto lens_sample = sampler.get_2d();
+    auto ray_origin =
+        defocus_angle <= 0 ? center : defocus_disk_sample(lens_sample);
     auto ray_direction = pixel_sample - ray_origin;
 
-    auto ray_time = random_double();
+    auto ray_time = sampler.get_1d();
 
-    return Ray(ray_origin, ray_direction, ray_time);
+    Ray ray(ray_origin, ray_direction, ray_time);
+    if (ray_differentials) {
+        // 从同一光圈点射向相邻像素上的对应位置
+        ray.has_differentials = true;
+        ray.rx_origin = ray.ry_origin = ray_origin;
+        ray.rx_dir = ray_direction + differential_scale * pixel_delta_u;
+        ray.ry_dir = ray_direction + differential_scale * pixel_delta_v;
+    }
+    return ray;
 }
 
-Point3 Camera::defocus_disk_sample() const {
+Point3 Camera::defocus_disk_sample(const Point2& u) const {
     // 返回光圈平面内的随机一个点
-    auto p = random_in_unit_disk();
+    auto p = sample_unit_disk(u);
     return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 }
 
@@ -1,41 +1,97 @@
 #pragma once
 
+#include <memory>
+#include <string>
+#include "environment.h"
 #include "hittable.h"
+#include "film.h"
+#include "sampler.h"
 
 namespace cray {
 
+// 图像块[x0,x1)x[y0,y1)上序号为[sample_begin,sample_end)的采样
+struct RenderTask {
+    int x0, y0, x1, y1;
+    int sample_begin, sample_end;
+};
+
 class Camera {
 public:
-    // void render(const Hittable& world, std::ostream& out);
+    // 渲染线性radiance到film，色调映射和输出由调用方决定
+    void render(const Hittable& world, Film& film);
 
     void render_to_png(const Hittable& world, const char* file_name);
 
+    // 根据参数计算图像高度、视口等派生量
+    void init();
+
+    // 渲染一个块，返回块大小的film，调用前需要init()。
+    // 结果与由哪个进程、第几次重试渲染无关
+    Film render_tile(const Hittable& world, const RenderTask& task) const;
+
+    int height() const { return image_height; }
+
     int image_width = 100;
-    double aspect_ratio = 1.0;
+    Real aspect_ratio = 1.0;
 
-    double fov = 90;  // 垂直方向的fov
+    Real fov = 90;  // 垂直方向的fov
     Point3 position = Point3(0.0, 0.0, -1.0);
     Point3 look_at = Point3(0.0, 0.0, 0.0);
     Vec3 up = Vec3(0.0, 1.0, 0.0);
 
-    double focus_dist = 10.0;  // 焦距
-    double defocus_angle = 0.0;
+    Real focus_dist = 10.0;  // 焦距
+    Real defocus_angle = 0.0;
 
     int samples_per_pixel = 10;
     int max_depth = 10;
+    SamplerType sampler_type = SamplerType::Independent;
+    uint32_t seed = 0;  // 相同的seed得到逐位相同的图像
+    int threads = 0;    // 渲染线程数，<=0时使用全部硬件线程
 
     Color background;  // 背景颜色
+    // 非空时代替background，漫反射表面对它直接采样，并与散射方向做MIS
+    std::shared_ptr<const EnvironmentLight> environment;
+    bool environment_mis = true;  // false时只靠散射方向照到环境光
+
+    // 相机光线携带光线微分，纹理按像素足迹滤波
+    bool ray_differentials = true;
+
+    // 断点续渲，路径为空时不启用。进程被杀后用相同配置重新运行即可继续
+    std::string checkpoint_path;
+    double checkpoint_interval = 300.0;  // 两次checkpoint之间的最短秒数
+
+    // 时间预算(秒)，<=0时不限时。临近到期时缩短最后一个pass，
+    // 停在完整的pass上，samples_per_pixel作为采样数上限
+    double time_budget = 0.0;
+    // 每个pass结束后写出一张中间结果，为空时不输出。pass的采样数
+    // 按1, 2, 4, ...增长，中间结果的总采样数依次翻倍
+    std::string preview_path;
 
 private:
-    void init();
+    // 从checkpoint恢复film，返回下一个要渲染的采样序号
+    int resume(Film& film) const;
+    void save_checkpoint(const Film& film, int next_sample) const;
+
+    // 多线程渲染task，结果累加到film上以(film_x0, film_y0)为原点的位置
+    void render_region(const Hittable& world, Film& film,
+                       const RenderTask& task, int film_x0,
+                       int film_y0) const;
 
-    Vec3 pixel_sample_square() const;
+    Vec3 pixel_sample_square(const Point2& u) const;
 
-    Ray get_ray(int i, int j) const;
+    // 调用前需要sampler.start_pixel_sample
+    Ray get_ray(int i, int j, Sampler& sampler) const;
 
-    Color ray_color(const Ray& ray, const Hittable& world, int depth) const;
+    // scatter_pdf为上一个顶点按scatter采样ray方向的概率密度，
+    // 0表示相机光线或镜面方向，照到环境光时不做MIS
+    Color ray_color(const Ray& ray, const Hittable& world, int depth,
+                    Sampler& sampler, Real scatter_pdf = 0) const;
+    // 在交点处对环境光采样一个方向，返回乘上MIS权重的直接光照
+    Color sample_environment(const Ray& ray, const HitRecord& rec,
+                             const Hittable& world, Sampler& sampler,
+                             const Color& attenuation) const;
 
-    Point3 defocus_disk_sample() const;
+    Point3 defocus_disk_sample(const Point2& u) const;
 
     int image_height;
     Point3 center;       // Camera center
@@ -45,6 +101,9 @@ private:
 
     Vec3 u, v, w;  // 相机空间的三个轴
 
+    // 辅助光线的像素偏移，按每像素采样数缩小
+    Real differential_scale;
+
     // 光圈平面空间的u、v轴上的长度为光圈半径的向量
     Vec3 defocus_disk_u;
     Vec3 defocus_disk_v;
@@ -2,105 +2,173 @@
 
 #include <cmath>
 #include <iostream>
+#include <type_traits>
 #include "common.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CRAY_HAS_SSE 1
+#else
+#define CRAY_HAS_SSE 0
+#endif
+
 namespace cray {
 
-struct Vec3 {
-    Vec3() : e{0, 0, 0} {}
-    Vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+// 单精度时以16字节对齐的float4存储，运算走SSE；双精度时为3个double
+template <typename T>
+struct TVec3 {
+    static constexpr bool Simd = CRAY_HAS_SSE && std::is_same_v<T, float>;
+    static constexpr int Lanes = Simd ? 4 : 3;
+
+    TVec3() : TVec3(0, 0, 0) {}
+
+    TVec3(T e0, T e1, T e2) {
+#if CRAY_HAS_SSE
+        // 整体写入16字节，之后的向量load可以直接从store转发
+        if constexpr (Simd) {
+            _mm_store_ps(e, _mm_setr_ps(e0, e1, e2, 0));
+            return;
+        }
+#endif
+        e[0] = e0;
+        e[1] = e1;
+        e[2] = e2;
+    }
 
-    Vec3 operator-() const { return Vec3(-x, -y, -z); }
+    // 不同精度之间的显式转换
+    template <typename U>
+    explicit TVec3(const TVec3<U> &v)
+        : TVec3(static_cast<T>(v.x), static_cast<T>(v.y),
+                static_cast<T>(v.z)) {}
 
-    Vec3 &operator+=(const Vec3 &v) {
-        x += v.x;
-        y += v.y;
-        z += v.z;
-        return *this;
-    }
+    TVec3 operator-() const { return TVec3(-x, -y, -z); }
 
-    Vec3 &operator*=(double t) {
-        x *= t;
-        y *= t;
-        z *= t;
-        return *this;
-    }
+    TVec3 &operator+=(const TVec3 &v) { return *this = *this + v; }
+
+    TVec3 &operator*=(T t) { return *this = *this * t; }
 
-    Vec3 &operator/=(double t) { return *this *= 1 / t; }
+    TVec3 &operator/=(T t) { return *this *= 1 / t; }
 
-    double operator[](int i) const { return e[i]; }
-    double &operator[](int i) { return e[i]; }
+    T operator[](int i) const { return e[i]; }
+    T &operator[](int i) { return e[i]; }
 
-    double length() const { return sqrt(length_sq()); }
+    T length() const { return std::sqrt(length_sq()); }
 
-    double length_sq() const { return x * x + y * y + z * z; }
+    T length_sq() const { return dot(*this, *this); }
 
     bool near_zero() const {
         // Return true if the vector is close to zero in all dimensions.
         const auto s = 1e-8;
-        return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
+        return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
 
-    inline static Vec3 random() {
-        return Vec3(random_double(), random_double(), random_double());
+    inline static TVec3 random() {
+        return TVec3(random_double(), random_double(), random_double());
     }
 
-    inline static Vec3 random(double min, double max) {
-        return Vec3(random_double(min, max), random_double(min, max),
-                    random_double(min, max));
+    inline static TVec3 random(double min, double max) {
+        return TVec3(random_double(min, max), random_double(min, max),
+                     random_double(min, max));
     }
 
-    union {
-        double e[3];
-        struct {
-            double x;
-            double y;
-            double z;
-        };
-        struct {
-            double r;
-            double g;
-            double b;
-        };
-    };
-};
+    friend std::ostream &operator<<(std::ostream &out, const TVec3 &v) {
+        return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
+    }
 
-using Point3 = Vec3;
-using Color = Vec3;
+    friend TVec3 operator+(const TVec3 &u, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd) return from_m128(_mm_add_ps(u.m128(), v.m128()));
+#endif
+        return TVec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    }
 
-inline std::ostream &operator<<(std::ostream &out, const Vec3 &v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
+    friend TVec3 operator-(const TVec3 &u, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd) return from_m128(_mm_sub_ps(u.m128(), v.m128()));
+#endif
+        return TVec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    }
 
-inline Vec3 operator+(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
-}
+    friend TVec3 operator*(const TVec3 &u, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd) return from_m128(_mm_mul_ps(u.m128(), v.m128()));
+#endif
+        return TVec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    }
 
-inline Vec3 operator-(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
-}
+    friend TVec3 operator*(T t, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd)
+            return from_m128(_mm_mul_ps(_mm_set1_ps(t), v.m128()));
+#endif
+        return TVec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+    }
 
-inline Vec3 operator*(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
-}
+    friend TVec3 operator*(const TVec3 &v, T t) { return t * v; }
+
+    friend TVec3 operator/(TVec3 v, T t) { return (1 / t) * v; }
+
+    friend T dot(const TVec3 &u, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd) {
+            // 第4个分量恒为0，直接做4路水平求和
+            __m128 m = _mm_mul_ps(u.m128(), v.m128());
+            __m128 s = _mm_add_ps(m, _mm_movehl_ps(m, m));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+            return _mm_cvtss_f32(s);
+        }
+#endif
+        return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
+    }
 
-inline Vec3 operator*(double t, const Vec3 &v) {
-    return Vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
-}
+    friend TVec3 cross(const TVec3 &u, const TVec3 &v) {
+#if CRAY_HAS_SSE
+        if constexpr (Simd) {
+            __m128 a = u.m128(), b = v.m128();
+            __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+            return from_m128(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+        }
+#endif
+        return TVec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    }
+
+    union alignas(Simd ? 16 : alignof(T)) {
+        T e[Lanes];
+        struct {
+            T x;
+            T y;
+            T z;
+        };
+        struct {
+            T r;
+            T g;
+            T b;
+        };
+    };
 
-inline Vec3 operator*(const Vec3 &v, double t) { return t * v; }
+private:
+#if CRAY_HAS_SSE
+    __m128 m128() const { return _mm_load_ps(e); }
 
-inline Vec3 operator/(Vec3 v, double t) { return (1 / t) * v; }
+    static TVec3 from_m128(__m128 m) {
+        TVec3 v;
+        _mm_store_ps(v.e, m);
+        return v;
+    }
+#endif
+};
 
-inline double dot(const Vec3 &u, const Vec3 &v) {
-    return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
-}
+using Vec3 = TVec3<Real>;
+using Point3 = Vec3;
+using Color = Vec3;
 
-inline Vec3 cross(const Vec3 &u, const Vec3 &v) {
-    return Vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
-}
+// 累积radiance始终使用双精度
+using Vec3d = TVec3<double>;
 
 inline Vec3 unit_vector(Vec3 v) { return v / v.length(); }
 
@@ -137,11 +205,11 @@ inline Vec3 reflect(const Vec3 &v, const Vec3 &n) {
 }
 
 // 计算折射光  入射光 + 法线 + 两个平面的折射率的比值 -> 折射光
-inline Vec3 refract(const Vec3 &uv, const Vec3 &n, double etai_over_etat) {
-    auto cos_theta = fmin(dot(-uv, n), 1.0);
+inline Vec3 refract(const Vec3 &uv, const Vec3 &n, Real etai_over_etat) {
+    auto cos_theta = std::fmin(dot(-uv, n), Real(1));
     Vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    Vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_sq())) * n;
+    Vec3 r_out_parallel = -std::sqrt(fabs(1 - r_out_perp.length_sq())) * n;
     return r_out_perp + r_out_parallel;
 }
 
-}  // namespace cray
\ No newline at end of file
+}  // namespace cray
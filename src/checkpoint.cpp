@@ -0,0 +1,48 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace cray {
+
+static const char CheckpointMagic[8] = {'C', 'R', 'A', 'Y',
+                                        'C', 'K', 'P', '2'};
+
+bool write_checkpoint(const Checkpoint& ckpt, const std::string& path) {
+    auto tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary);
+    if (!out) return false;
+
+    int32_t header[2] = {ckpt.next_sample, static_cast<int32_t>(ckpt.seed)};
+    out.write(CheckpointMagic, sizeof(CheckpointMagic));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    bool written = ckpt.film.write(out);
+    // 关闭时才会写出缓冲区的剩余部分，必须在rename之前检查，
+    // 否则磁盘满时会用截断的文件替换上一个完整的检查点
+    out.close();
+    if (!written || !out.good()) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool read_checkpoint(Checkpoint& ckpt, const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    char magic[sizeof(CheckpointMagic)];
+    int32_t header[2];
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, CheckpointMagic, sizeof(magic)) != 0)
+        return false;
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)))
+        return false;
+
+    ckpt.next_sample = header[0];
+    ckpt.seed = static_cast<uint32_t>(header[1]);
+    return ckpt.film.read(in);
+}
+
+}  // namespace cray
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include "film.h"
+
+namespace cray {
+
+// 长时间渲染的断点：累积缓冲、每像素采样数以及采样序号。
+// 随机数由(像素, 采样序号, seed)决定，不需要保存发生器状态
+struct Checkpoint {
+    int next_sample = 0;  // 所有像素都已完成[0, next_sample)的采样
+    uint32_t seed = 0;
+    Film film;
+};
+
+// 先写临时文件再rename，进程在写入途中被杀也不会破坏旧的checkpoint
+bool write_checkpoint(const Checkpoint& ckpt, const std::string& path);
+bool read_checkpoint(Checkpoint& ckpt, const std::string& path);
+
+}  // namespace cray
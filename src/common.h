@@ -1,7 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
-#include <random>
+
+// 几何与着色计算使用的浮点类型，定义CRAY_FLOAT_PRECISION时为单精度
+#ifdef CRAY_FLOAT_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
 
 // Constants
 
@@ -16,11 +23,47 @@ inline double degrees_to_radians(double degrees) {
     return degrees * PI / 180.0;
 }
 
+// splitmix64的混合函数
+inline uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ull;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dull;
+    v ^= v >> 33;
+    return v;
+}
+
+// 把若干整数哈希成一个64位值
+template <typename... Args>
+inline uint64_t hash_values(Args... args) {
+    uint64_t h = 0;
+    ((h = mix_bits(h ^ (static_cast<uint64_t>(args) + 0x9e3779b97f4a7c15ull))),
+     ...);
+    return h;
+}
+
+// 基于计数器的随机数流，第n个数为hash(key, n)。每个线程一个流，
+// 渲染时按(像素, 采样序号, seed)设置key，结果与线程数和调度顺序无关
+struct RandomStream {
+    uint64_t key = 0;
+    uint64_t counter = 0;
+};
+
+inline RandomStream& random_stream() {
+    thread_local RandomStream stream;
+    return stream;
+}
+
+inline void seed_random_stream(uint64_t key) {
+    random_stream() = RandomStream{key, 0};
+}
+
 // retrun [0,1)
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    auto& stream = random_stream();
+    auto n = ++stream.counter;
+    auto bits = mix_bits(stream.key ^ mix_bits(n * 0x9e3779b97f4a7c15ull));
+    return (bits >> 11) * 0x1p-53;
 }
 
 // retrun [min,max)
@@ -39,4 +82,10 @@ inline int clamp(int x, int low, int high) {
     if (x < low) return low;
     if (x < high) return x;
     return high - 1;
+}
+
+// 截断后修正，结果与std::floor相同，没有SSE4.1时省去函数调用
+inline int floor_int(Real x) {
+    int i = static_cast<int>(x);
+    return x < i ? i - 1 : i;
 }
\ No newline at end of file
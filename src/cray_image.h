@@ -1,25 +1,59 @@
 #pragma once
 
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include "stb_image.h"
 #include "common.h"
 
 namespace cray {
 
+// 8位RGB图像；HDR文件(.hdr)按float RGB读入，不做色调映射
 class CRayImage {
 public:
-    CRayImage() : data_(nullptr) {}
+    CRayImage() {}
     CRayImage(const std::string& path) {
-        data_ = stbi_load(path.c_str(), &width_, &height_, &nr_components_,
-                          bytes_per_pixel);
+        if (stbi_is_hdr(path.c_str()))
+            hdr_data_ = stbi_loadf(path.c_str(), &width_, &height_,
+                                   &nr_components_, bytes_per_pixel);
+        else
+            data_ = stbi_load(path.c_str(), &width_, &height_,
+                              &nr_components_, bytes_per_pixel);
         bytes_per_scanline_ = width_ * bytes_per_pixel;
     }
-    ~CRayImage() { stbi_image_free(data_); }
+    // 解码已读入内存的文件内容
+    CRayImage(const unsigned char* bytes, size_t size) {
+        int len = static_cast<int>(size);
+        if (stbi_is_hdr_from_memory(bytes, len))
+            hdr_data_ = stbi_loadf_from_memory(bytes, len, &width_, &height_,
+                                               &nr_components_,
+                                               bytes_per_pixel);
+        else
+            data_ = stbi_load_from_memory(bytes, len, &width_, &height_,
+                                          &nr_components_, bytes_per_pixel);
+        bytes_per_scanline_ = width_ * bytes_per_pixel;
+    }
+    // 程序生成的HDR图像，rgb为逐行的width*height个float RGB
+    CRayImage(int width, int height, const float* rgb)
+        : width_(width),
+          height_(height) {
+        nr_components_ = bytes_per_pixel;
+        // 与stb解码的图像一样由stbi_image_free(即free)释放
+        size_t bytes = sizeof(float) * bytes_per_pixel * width * height;
+        hdr_data_ = static_cast<float*>(std::malloc(bytes));
+        std::memcpy(hdr_data_, rgb, bytes);
+        bytes_per_scanline_ = width_ * bytes_per_pixel;
+    }
+    ~CRayImage() {
+        stbi_image_free(data_);
+        stbi_image_free(hdr_data_);
+    }
 
-    bool invalid() const { return data_ == nullptr; }
+    bool invalid() const { return data_ == nullptr && hdr_data_ == nullptr; }
+    bool hdr() const { return hdr_data_ != nullptr; }
 
-    int width() const { return data_ == nullptr ? 0 : width_; }
-    int height() const { return data_ == nullptr ? 0 : height_; }
+    int width() const { return invalid() ? 0 : width_; }
+    int height() const { return invalid() ? 0 : height_; }
 
     const unsigned char* pixel_data(int x, int y) const {
         if (data_ == nullptr) return Magenta;
@@ -30,12 +64,21 @@ public:
         return data_ + y * bytes_per_scanline_ + x * bytes_per_pixel;
     }
 
+    // HDR图像的线性RGB
+    const float* hdr_pixel_data(int x, int y) const {
+        x = clamp(x, 0, width_);
+        y = clamp(y, 0, height_);
+
+        return hdr_data_ + y * bytes_per_scanline_ + x * bytes_per_pixel;
+    }
+
 private:
-    unsigned char* data_;
-    int width_, height_, nr_components_;
-    int bytes_per_scanline_;
+    unsigned char* data_ = nullptr;
+    float* hdr_data_ = nullptr;
+    int width_ = 0, height_ = 0, nr_components_ = 0;
+    int bytes_per_scanline_ = 0;
 
     const int bytes_per_pixel = 3;
 };
 
-}  // namespace cray
\ No newline at end of file
+}  // namespace cray
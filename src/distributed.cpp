@@ -0,0 +1,373 @@
+#include "distributed.h"
+#include <iostream>
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace cray {
+
+namespace {
+
+const int32_t TaskMessage = 1;
+
+struct Task {
+    int id;
+    RenderTask task;
+    int attempts = 0;
+};
+
+bool write_all(int fd, const void* data, size_t size) {
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        // 对端已退出时返回错误而不是触发SIGPIPE
+        auto n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+    auto p = static_cast<char*>(data);
+    while (size > 0) {
+        auto n = recv(fd, p, size, 0);
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool send_task(int fd, const Task& t) {
+    int32_t msg[8] = {TaskMessage, t.id,      t.task.x0,
+                      t.task.y0,   t.task.x1, t.task.y1,
+                      t.task.sample_begin,    t.task.sample_end};
+    return write_all(fd, msg, sizeof(msg));
+}
+
+bool send_result(int fd, int id, const Film& tile) {
+    std::ostringstream out;
+    tile.write(out);
+    auto bytes = out.str();
+
+    int32_t header_id = id;
+    uint64_t size = bytes.size();
+    return write_all(fd, &header_id, sizeof(header_id)) &&
+           write_all(fd, &size, sizeof(size)) &&
+           write_all(fd, bytes.data(), bytes.size());
+}
+
+bool receive_result(int fd, int& id, Film& tile) {
+    int32_t header_id;
+    uint64_t size;
+    if (!read_all(fd, &header_id, sizeof(header_id)) ||
+        !read_all(fd, &size, sizeof(size)))
+        return false;
+
+    std::string bytes(size, '\0');
+    if (!read_all(fd, bytes.data(), size)) return false;
+
+    id = header_id;
+    std::istringstream in(bytes);
+    return tile.read(in);
+}
+
+int connect_worker(const std::string& address) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) return -1;
+    auto host = address.substr(0, colon);
+    auto port = address.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+        return -1;
+
+    int fd = -1;
+    for (auto ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+// 待分发的任务，worker线程从这里取任务，失败时放回
+class TaskQueue {
+public:
+    TaskQueue(std::deque<Task> tasks, int max_retries)
+        : pending_(std::move(tasks)),
+          max_retries_(max_retries) {}
+
+    // 没有剩余任务且没有在途任务时返回false
+    bool pop(Task& task) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock,
+                   [this] { return !pending_.empty() || in_flight_ == 0; });
+        if (pending_.empty()) return false;
+
+        task = pending_.front();
+        pending_.pop_front();
+        in_flight_++;
+        return true;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_--;
+        cond_.notify_all();
+    }
+
+    // 重试次数用完的任务留给coordinator自己渲染
+    void retry(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_--;
+        retries_++;
+        if (++task.attempts > max_retries_) {
+            local_.push_back(task);
+        } else {
+            pending_.push_back(task);
+        }
+        cond_.notify_all();
+    }
+
+    // worker全部退出后剩下的任务
+    std::deque<Task> leftover() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto tasks = std::move(local_);
+        tasks.insert(tasks.end(), pending_.begin(), pending_.end());
+        pending_.clear();
+        return tasks;
+    }
+
+    int retries() const { return retries_; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Task> pending_;
+    std::deque<Task> local_;
+    int in_flight_ = 0;
+    int retries_ = 0;
+    int max_retries_;
+};
+
+// 按任务id顺序合并，使浮点累加顺序与任务完成的先后无关
+class FilmMerger {
+public:
+    FilmMerger(Film& film) : film_(film) {}
+
+    void add(const Task& task, Film tile) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.emplace(task.id, std::make_pair(task.task, std::move(tile)));
+
+        while (!pending_.empty() && pending_.begin()->first == next_id_) {
+            auto& [t, f] = pending_.begin()->second;
+            film_.merge(f, t.x0, t.y0);
+            pending_.erase(pending_.begin());
+            next_id_++;
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    Film& film_;
+    std::map<int, std::pair<RenderTask, Film>> pending_;
+    int next_id_ = 0;
+};
+
+void set_timeout(int fd, double seconds) {
+    if (seconds <= 0) return;
+    timeval tv;
+    tv.tv_sec = static_cast<time_t>(seconds);
+    tv.tv_usec = static_cast<suseconds_t>((seconds - tv.tv_sec) * 1e6);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+void run_worker_connection(int fd, const std::string& name, TaskQueue& queue,
+                           FilmMerger& merger) {
+    Task task;
+    while (queue.pop(task)) {
+        int id;
+        Film tile;
+        if (!send_task(fd, task) || !receive_result(fd, id, tile) ||
+            id != task.id) {
+            std::clog << "worker " << name << " failed on task " << task.id
+                      << ", rescheduling\n";
+            queue.retry(task);
+            break;
+        }
+        merger.add(task, std::move(tile));
+        queue.finish();
+    }
+    close(fd);
+}
+
+}  // namespace
+
+bool render_distributed(Camera& cam, const Hittable& world, Film& film,
+                        const DistributedOptions& options) {
+    cam.init();
+    film = Film(cam.image_width, cam.height());
+
+    auto render_start = std::chrono::steady_clock::now();
+
+    // 切分任务：外层按采样区间，内层按图像块
+    int tile_size = options.tile_size > 0 ? options.tile_size : film.width();
+    int samples_per_task = options.samples_per_task > 0
+                               ? options.samples_per_task
+                               : cam.samples_per_pixel;
+    std::deque<Task> tasks;
+    for (int s0 = 0; s0 < cam.samples_per_pixel; s0 += samples_per_task) {
+        int s1 = std::min(s0 + samples_per_task, cam.samples_per_pixel);
+        for (int y0 = 0; y0 < film.height(); y0 += tile_size) {
+            for (int x0 = 0; x0 < film.width(); x0 += tile_size) {
+                Task t;
+                t.id = static_cast<int>(tasks.size());
+                t.task = RenderTask{x0,
+                                    y0,
+                                    std::min(x0 + tile_size, film.width()),
+                                    std::min(y0 + tile_size, film.height()),
+                                    s0,
+                                    s1};
+                tasks.push_back(t);
+            }
+        }
+    }
+    auto task_count = tasks.size();
+
+    // 先fork本机worker，再创建线程
+    std::vector<std::pair<int, std::string>> connections;
+    std::vector<pid_t> children;
+    for (int i = 0; i < options.local_workers; ++i) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) break;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sv[0]);
+            for (auto& [fd, name] : connections) close(fd);
+            serve_connection(cam, world, sv[1]);
+            _exit(0);
+        }
+        close(sv[1]);
+        if (pid < 0) {
+            close(sv[0]);
+            break;
+        }
+        children.push_back(pid);
+        connections.emplace_back(sv[0], "local#" + std::to_string(i));
+    }
+    for (auto& address : options.workers) {
+        int fd = connect_worker(address);
+        if (fd < 0) {
+            std::clog << "cannot connect to worker " << address << '\n';
+            continue;
+        }
+        connections.emplace_back(fd, address);
+    }
+    for (auto& [fd, name] : connections) set_timeout(fd, options.task_timeout);
+
+    TaskQueue queue(std::move(tasks), options.max_retries);
+    FilmMerger merger(film);
+
+    std::vector<std::thread> threads;
+    for (auto& [fd, name] : connections) {
+        threads.emplace_back(run_worker_connection, fd, name, std::ref(queue),
+                             std::ref(merger));
+    }
+    for (auto& t : threads) t.join();
+    for (auto pid : children) waitpid(pid, nullptr, 0);
+
+    auto leftover = queue.leftover();
+    for (auto& task : leftover) {
+        merger.add(task, cam.render_tile(world, task.task));
+    }
+
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - render_start)
+                       .count();
+    std::clog << "distributed: " << task_count << " tasks on "
+              << connections.size() << " workers, " << queue.retries()
+              << " retries, " << leftover.size() << " rendered locally, "
+              << seconds << " s\n";
+    return true;
+}
+
+void serve_connection(const Camera& cam, const Hittable& world, int fd) {
+    int32_t msg[8];
+    while (read_all(fd, msg, sizeof(msg)) && msg[0] == TaskMessage) {
+        RenderTask task{msg[2], msg[3], msg[4], msg[5], msg[6], msg[7]};
+        if (!send_result(fd, msg[1], cam.render_tile(world, task))) break;
+    }
+}
+
+void serve_worker(Camera& cam, const Hittable& world, int port) {
+    cam.init();
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+            0 ||
+        listen(listen_fd, 8) != 0) {
+        std::clog << "worker cannot listen on port " << port << '\n';
+        return;
+    }
+
+    std::clog << "worker listening on port " << port << '\n';
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        serve_connection(cam, world, fd);
+        close(fd);
+    }
+}
+
+}  // namespace cray
+
+#else
+
+namespace cray {
+
+bool render_distributed(Camera& cam, const Hittable& world, Film& film,
+                        const DistributedOptions& options) {
+    std::clog << "distributed rendering is not supported on this platform\n";
+    return false;
+}
+
+void serve_worker(Camera& cam, const Hittable& world, int port) {
+    std::clog << "distributed rendering is not supported on this platform\n";
+}
+
+void serve_connection(const Camera& cam, const Hittable& world, int fd) {}
+
+}  // namespace cray
+
+#endif
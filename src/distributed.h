@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "camera.h"
+
+namespace cray {
+
+// 多进程渲染：coordinator把图像切成块和采样区间分发给worker，
+// worker返回浮点film，由coordinator合并
+struct DistributedOptions {
+    std::vector<std::string> workers;  // 远程worker，"host:port"
+    int local_workers = 0;             // fork出的本机worker数量
+
+    int tile_size = 64;
+    int samples_per_task = 0;  // 每个任务的采样数，<=0时不按采样切分
+    int max_retries = 3;       // 单个任务最多重新分发的次数
+    double task_timeout = 0;   // 等待单个任务结果的秒数，<=0时不超时
+};
+
+// coordinator，失败的任务会重新分发给其他worker，
+// 所有worker都失败时剩余的任务在本进程内渲染
+bool render_distributed(Camera& cam, const Hittable& world, Film& film,
+                        const DistributedOptions& options);
+
+// worker，在TCP端口上依次服务coordinator的连接，只在监听失败时返回
+void serve_worker(Camera& cam, const Hittable& world, int port);
+
+// 在已连接的socket上处理任务，直到对端关闭连接。
+// 调用前需要cam.init()
+void serve_connection(const Camera& cam, const Hittable& world, int fd);
+
+}  // namespace cray
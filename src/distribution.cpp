@@ -0,0 +1,66 @@
+#include "distribution.h"
+#include <algorithm>
+
+namespace cray {
+
+Distribution1D::Distribution1D(const Real* f, int n)
+    : func_(f, f + n),
+      cdf_(n + 1) {
+    cdf_[0] = 0;
+    for (int i = 0; i < n; ++i) cdf_[i + 1] = cdf_[i] + func_[i] / n;
+    integral_ = cdf_[n];
+    for (int i = 1; i <= n; ++i)
+        cdf_[i] = integral_ > 0 ? cdf_[i] / integral_ : Real(i) / n;
+}
+
+Real Distribution1D::sample(Real u, Real& pdf, int& index) const {
+    // cdf_[index] <= u < cdf_[index + 1]
+    auto it = std::upper_bound(cdf_.begin(), cdf_.end(), u);
+    index = std::clamp(static_cast<int>(it - cdf_.begin()) - 1, 0,
+                       count() - 1);
+    auto du = u - cdf_[index];
+    auto width = cdf_[index + 1] - cdf_[index];
+    if (width > 0) du /= width;
+    pdf = integral_ > 0 ? func_[index] / integral_ : 1;
+    return (index + du) / count();
+}
+
+static std::vector<Real> row_integrals(
+    const std::vector<Distribution1D>& rows) {
+    std::vector<Real> integrals;
+    for (const auto& row : rows) integrals.push_back(row.integral());
+    return integrals;
+}
+
+static std::vector<Distribution1D> make_rows(const Real* f, int width,
+                                             int height) {
+    std::vector<Distribution1D> rows;
+    rows.reserve(height);
+    for (int y = 0; y < height; ++y)
+        rows.emplace_back(f + static_cast<size_t>(y) * width, width);
+    return rows;
+}
+
+Distribution2D::Distribution2D(const Real* f, int width, int height)
+    : rows_(make_rows(f, width, height)),
+      marginal_(row_integrals(rows_).data(), height) {}
+
+Point2 Distribution2D::sample(const Point2& u, Real& pdf) const {
+    Real pdf_t, pdf_s;
+    int row, column;
+    auto t = marginal_.sample(static_cast<Real>(u.y), pdf_t, row);
+    auto s = rows_[row].sample(static_cast<Real>(u.x), pdf_s, column);
+    pdf = pdf_s * pdf_t;
+    return Point2{s, t};
+}
+
+Real Distribution2D::pdf(Real s, Real t) const {
+    const auto& row = rows_[std::clamp(
+        static_cast<int>(t * marginal_.count()), 0, marginal_.count() - 1)];
+    int column =
+        std::clamp(static_cast<int>(s * row.count()), 0, row.count() - 1);
+    if (!(marginal_.integral() > 0)) return 1;
+    return row.value(column) / marginal_.integral();
+}
+
+}  // namespace cray
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include "cgmath.h"
+#include "sampler.h"
+
+namespace cray {
+
+// [0,1)上的一维分段常数分布，第i段的函数值为f[i]。
+// f全为0时退化为均匀分布
+class Distribution1D {
+public:
+    Distribution1D(const Real* f, int n);
+
+    // 按f的比例采样u∈[0,1)，返回[0,1)中的位置。
+    // pdf为相对[0,1)的密度，index为所在的段
+    Real sample(Real u, Real& pdf, int& index) const;
+
+    int count() const { return static_cast<int>(func_.size()); }
+    // f在[0,1)上的积分
+    Real integral() const { return integral_; }
+    Real value(int i) const { return func_[i]; }
+
+private:
+    std::vector<Real> func_;
+    std::vector<Real> cdf_;  // count()+1项，cdf_[0]=0，cdf_[count()]=1
+    Real integral_;
+};
+
+// [0,1)^2上的二维分段常数分布，f为width*height的行优先数组。
+// 先按各行的积分选行，再在行内按列采样
+class Distribution2D {
+public:
+    Distribution2D(const Real* f, int width, int height);
+
+    // 返回[0,1)^2中的点，pdf为相对[0,1)^2的密度
+    Point2 sample(const Point2& u, Real& pdf) const;
+    Real pdf(Real s, Real t) const;
+
+private:
+    std::vector<Distribution1D> rows_;
+    Distribution1D marginal_;
+};
+
+}  // namespace cray
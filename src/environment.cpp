@@ -0,0 +1,92 @@
+#include "environment.h"
+#include <filesystem>
+#include "image_registry.h"
+
+namespace cray {
+
+static std::shared_ptr<const MipMap> load_environment(const std::string& path) {
+    auto format = std::filesystem::path(path).extension() == ".hdr"
+                      ? TexFormat::Half
+                      : TexFormat::SRGB8;
+    return image_registry().load(path, format).get();
+}
+
+EnvironmentLight::EnvironmentLight(const std::string& path, Real scale)
+    : EnvironmentLight(load_environment(path), scale) {}
+
+EnvironmentLight::EnvironmentLight(std::shared_ptr<const MipMap> image,
+                                   Real scale)
+    : image_(std::move(image)),
+      scale_(scale) {
+    if (image_->empty()) return;
+
+    int width = image_->width(0), height = image_->height(0);
+    std::vector<Real> luminance(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            auto c = image_->nearest((x + 0.5) / width, (y + 0.5) / height);
+            luminance[static_cast<size_t>(y) * width + x] =
+                0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+        }
+    }
+
+    // radiance()是双线性插值，一个纹素范围内的值来自周围3x3个纹素，
+    // 取其中的最大亮度保证pdf不小于radiance的比例，太阳边缘不会出现萤火虫。
+    // 再乘以所在行的sinθ，即单位(s,t)面积对应的立体角比例
+    std::vector<Real> f(luminance.size());
+    for (int y = 0; y < height; ++y) {
+        auto sin_theta = std::sin(PI * (y + 0.5) / height);
+        for (int x = 0; x < width; ++x) {
+            Real max = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                int ny = clamp(y + dy, 0, height);
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = clamp(x + dx, 0, width);
+                    max = std::max(
+                        max, luminance[static_cast<size_t>(ny) * width + nx]);
+                }
+            }
+            f[static_cast<size_t>(y) * width + x] = max * sin_theta;
+        }
+    }
+    distribution_ = std::make_unique<Distribution2D>(f.data(), width, height);
+}
+
+Color EnvironmentLight::radiance(const Vec3& dir) const {
+    if (image_->empty()) return Color(0, 0, 0);
+    auto d = unit_vector(dir);
+    auto theta = std::acos(std::clamp(d.y, Real(-1), Real(1)));
+    auto phi = std::atan2(-d.z, d.x) + PI;
+    return scale_ * image_->bilinear(0, phi / (2 * PI), theta / PI);
+}
+
+Color EnvironmentLight::sample(const Point2& u, Vec3& wi, Real& pdf) const {
+    pdf = 0;
+    if (image_->empty()) return Color(0, 0, 0);
+
+    Real pdf_st;
+    auto st = distribution_->sample(u, pdf_st);
+    auto theta = PI * st.y, phi = 2 * PI * st.x;
+    auto sin_theta = std::sin(theta);
+    if (!(pdf_st > 0) || sin_theta <= 0) return Color(0, 0, 0);
+
+    wi = Vec3(-std::cos(phi) * sin_theta, std::cos(theta),
+              std::sin(phi) * sin_theta);
+    // (s,t)到立体角的雅可比为 2π·π·sinθ
+    pdf = pdf_st / (2 * PI * PI * sin_theta);
+    return radiance(wi);
+}
+
+Real EnvironmentLight::pdf(const Vec3& dir) const {
+    if (image_->empty()) return 0;
+    auto d = unit_vector(dir);
+    auto y = std::clamp(d.y, Real(-1), Real(1));
+    auto sin_theta = std::sqrt(1 - y * y);
+    if (sin_theta <= 0) return 0;
+    auto theta = std::acos(y);
+    auto phi = std::atan2(-d.z, d.x) + PI;
+    return distribution_->pdf(phi / (2 * PI), theta / PI) /
+           (2 * PI * PI * sin_theta);
+}
+
+}  // namespace cray
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "distribution.h"
+#include "mipmap.h"
+
+namespace cray {
+
+// 等距柱状投影的HDR环境光，包围整个场景，位于无穷远处。
+// 图像的列对应φ∈[0,2π)，行对应θ∈[0,π]，第一行朝向+y，
+// 与get_sphere_uv的参数化一致。
+// 按亮度乘sinθ预计算二维分段常数分布，可以按立体角重要性采样，
+// 很小很亮的太阳也能被直接采样到
+class EnvironmentLight {
+public:
+    // scale缩放亮度
+    EnvironmentLight(std::shared_ptr<const MipMap> image, Real scale = 1);
+    // .hdr按half存放，其余图像按sRGB解码
+    explicit EnvironmentLight(const std::string& path, Real scale = 1);
+
+    bool empty() const { return image_->empty(); }
+
+    // 沿方向dir看到的radiance，dir不需要归一化
+    Color radiance(const Vec3& dir) const;
+    // 按亮度采样单位方向wi，返回其radiance，pdf为立体角密度。
+    // pdf为0时样本无效
+    Color sample(const Point2& u, Vec3& wi, Real& pdf) const;
+    Real pdf(const Vec3& dir) const;
+
+private:
+    std::shared_ptr<const MipMap> image_;
+    Real scale_;
+    std::unique_ptr<Distribution2D> distribution_;
+};
+
+}  // namespace cray
@@ -0,0 +1,239 @@
+#include "film.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+
+namespace cray {
+
+bool Film::merge(const Film& other) {
+    if (other.width_ != width_ || other.height_ != height_) return false;
+
+    for (size_t i = 0; i < sum_.size(); ++i) {
+        sum_[i] += other.sum_[i];
+        count_[i] += other.count_[i];
+    }
+    return true;
+}
+
+bool Film::merge(const Film& tile, int x0, int y0) {
+    if (x0 < 0 || y0 < 0 || x0 + tile.width_ > width_ ||
+        y0 + tile.height_ > height_)
+        return false;
+
+    for (int j = 0; j < tile.height_; ++j) {
+        for (int i = 0; i < tile.width_; ++i) {
+            auto index = pixel_index(x0 + i, y0 + j);
+            sum_[index] += tile.sum_[tile.pixel_index(i, j)];
+            count_[index] += tile.count_[tile.pixel_index(i, j)];
+        }
+    }
+    return true;
+}
+
+void Film::clear() {
+    std::fill(sum_.begin(), sum_.end(), Vec3d(0, 0, 0));
+    std::fill(count_.begin(), count_.end(), 0);
+}
+
+bool Film::write(std::ostream& out) const {
+    int32_t size[2] = {width_, height_};
+    out.write(reinterpret_cast<const char*>(size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(sum_.data()),
+              sum_.size() * sizeof(Vec3d));
+    out.write(reinterpret_cast<const char*>(count_.data()),
+              count_.size() * sizeof(uint32_t));
+    return static_cast<bool>(out);
+}
+
+bool Film::read(std::istream& in) {
+    int32_t size[2];
+    if (!in.read(reinterpret_cast<char*>(size), sizeof(size))) return false;
+    if (size[0] < 0 || size[1] < 0) return false;
+
+    *this = Film(size[0], size[1]);
+    in.read(reinterpret_cast<char*>(sum_.data()), sum_.size() * sizeof(Vec3d));
+    in.read(reinterpret_cast<char*>(count_.data()),
+            count_.size() * sizeof(uint32_t));
+    return static_cast<bool>(in);
+}
+
+bool write_pfm(const Film& film, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    // 比例因子为负数表示little endian
+    out << "PF\n" << film.width() << ' ' << film.height() << "\n-1.0\n";
+
+    // PFM的扫描线从下往上存储
+    std::vector<float> row(film.width() * 3);
+    for (int j = film.height() - 1; j >= 0; --j) {
+        for (int i = 0; i < film.width(); ++i) {
+            auto c = film.pixel(i, j);
+            row[i * 3] = static_cast<float>(c.r);
+            row[i * 3 + 1] = static_cast<float>(c.g);
+            row[i * 3 + 2] = static_cast<float>(c.b);
+        }
+        out.write(reinterpret_cast<const char*>(row.data()),
+                  row.size() * sizeof(float));
+    }
+
+    return static_cast<bool>(out);
+}
+
+bool read_pfm(const std::string& path, Film& film) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int width, height;
+    double scale;
+    if (!(in >> magic >> width >> height >> scale) || magic != "PF" ||
+        width <= 0 || height <= 0 || scale >= 0)
+        return false;
+    in.get();
+
+    film = Film(width, height);
+    std::vector<float> row(width * 3);
+    for (int j = height - 1; j >= 0; --j) {
+        if (!in.read(reinterpret_cast<char*>(row.data()),
+                     row.size() * sizeof(float)))
+            return false;
+        for (int i = 0; i < width; ++i) {
+            film.add_sample(
+                i, j, Color(row[i * 3], row[i * 3 + 1], row[i * 3 + 2]));
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// EXR中的数值都是little endian
+class ByteWriter {
+public:
+    void u8(uint8_t v) { bytes.push_back(v); }
+    void i32(int32_t v) { raw(&v, sizeof(v)); }
+    void u64(uint64_t v) { raw(&v, sizeof(v)); }
+    void f32(float v) { raw(&v, sizeof(v)); }
+    void str(const char* s) { raw(s, strlen(s) + 1); }
+
+    void raw(const void* data, size_t size) {
+        auto p = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), p, p + size);
+    }
+
+    void attribute(const char* name, const char* type, int32_t size) {
+        str(name);
+        str(type);
+        i32(size);
+    }
+
+    std::vector<uint8_t> bytes;
+};
+
+}  // namespace
+
+bool write_exr(const Film& film, const std::string& path, int tile_size) {
+    const int width = film.width();
+    const int height = film.height();
+    if (width <= 0 || height <= 0 || tile_size <= 0) return false;
+
+    // 通道名必须按字母序排列
+    const char* channels[] = {"B", "G", "R"};
+    const int channel_comp[] = {2, 1, 0};
+    const int32_t pixel_type_float = 2;
+
+    ByteWriter w;
+    w.i32(20000630);  // magic number
+    w.i32(2 | 0x200);  // version 2，单层tiled文件
+
+    w.attribute("channels", "chlist", 3 * (2 + 16) + 1);
+    for (auto name : channels) {
+        w.str(name);
+        w.i32(pixel_type_float);
+        w.u8(0);  // pLinear
+        w.u8(0);
+        w.u8(0);
+        w.u8(0);
+        w.i32(1);  // xSampling
+        w.i32(1);  // ySampling
+    }
+    w.u8(0);
+
+    w.attribute("compression", "compression", 1);
+    w.u8(0);  // NO_COMPRESSION
+
+    for (auto name : {"dataWindow", "displayWindow"}) {
+        w.attribute(name, "box2i", 16);
+        w.i32(0);
+        w.i32(0);
+        w.i32(width - 1);
+        w.i32(height - 1);
+    }
+
+    w.attribute("lineOrder", "lineOrder", 1);
+    w.u8(0);  // INCREASING_Y
+
+    w.attribute("pixelAspectRatio", "float", 4);
+    w.f32(1.0f);
+
+    w.attribute("screenWindowCenter", "v2f", 8);
+    w.f32(0.0f);
+    w.f32(0.0f);
+
+    w.attribute("screenWindowWidth", "float", 4);
+    w.f32(1.0f);
+
+    w.attribute("tiles", "tiledesc", 9);
+    w.i32(tile_size);
+    w.i32(tile_size);
+    w.u8(0);  // ONE_LEVEL, ROUND_DOWN
+
+    w.u8(0);  // header结束
+
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+
+    // offset table，先占位，写完tile后回填
+    size_t table_pos = w.bytes.size();
+    for (int i = 0; i < tiles_x * tiles_y; ++i) w.u64(0);
+
+    std::vector<float> line(tile_size);
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            uint64_t offset = w.bytes.size();
+            memcpy(w.bytes.data() + table_pos +
+                       (ty * tiles_x + tx) * sizeof(uint64_t),
+                   &offset, sizeof(offset));
+
+            int x0 = tx * tile_size;
+            int y0 = ty * tile_size;
+            int tw = std::min(tile_size, width - x0);
+            int th = std::min(tile_size, height - y0);
+
+            w.i32(tx);
+            w.i32(ty);
+            w.i32(0);  // level x
+            w.i32(0);  // level y
+            w.i32(tw * th * 3 * static_cast<int>(sizeof(float)));
+
+            // 每条扫描线内按通道依次存储
+            for (int y = y0; y < y0 + th; ++y) {
+                for (int c = 0; c < 3; ++c) {
+                    for (int x = 0; x < tw; ++x) {
+                        line[x] = static_cast<float>(
+                            film.pixel(x0 + x, y)[channel_comp[c]]);
+                    }
+                    w.raw(line.data(), tw * sizeof(float));
+                }
+            }
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(w.bytes.data()), w.bytes.size());
+    return static_cast<bool>(out);
+}
+
+}  // namespace cray
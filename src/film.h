@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "cgmath.h"
+
+namespace cray {
+
+// 线性HDR累积缓冲，每个像素记录radiance之和以及采样数，
+// 不同机器/不同批次的部分结果可以直接merge
+class Film {
+public:
+    Film() : width_(0), height_(0) {}
+    Film(int width, int height)
+        : width_(width),
+          height_(height),
+          sum_(static_cast<size_t>(width) * height),
+          count_(static_cast<size_t>(width) * height, 0) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    void add_sample(int x, int y, const Color& c) {
+        auto index = pixel_index(x, y);
+        sum_[index] += Vec3d(c);
+        count_[index] += 1;
+    }
+
+    // 累加另一张相同尺寸的film
+    bool merge(const Film& other);
+    // 把一个块累加到以(x0, y0)为左上角的区域
+    bool merge(const Film& tile, int x0, int y0);
+
+    // 像素的平均radiance，没有采样的像素返回黑色
+    Vec3d pixel(int x, int y) const {
+        auto index = pixel_index(x, y);
+        if (count_[index] == 0) return Vec3d(0, 0, 0);
+        return sum_[index] / count_[index];
+    }
+
+    const Vec3d& sum(int x, int y) const { return sum_[pixel_index(x, y)]; }
+    uint32_t count(int x, int y) const { return count_[pixel_index(x, y)]; }
+
+    void clear();
+
+    // 原始二进制形式(尺寸、sum、count)，用于checkpoint与跨进程传输
+    bool write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    size_t pixel_index(int x, int y) const {
+        return static_cast<size_t>(y) * width_ + x;
+    }
+
+    int width_, height_;
+    // 与渲染精度无关，始终以双精度累加和序列化
+    std::vector<Vec3d> sum_;
+    std::vector<uint32_t> count_;
+};
+
+// 无损浮点输出
+bool write_pfm(const Film& film, const std::string& path);
+// 读取write_pfm写出的3通道PFM，每个像素记为一个采样
+bool read_pfm(const std::string& path, Film& film);
+// 无压缩、分块(tiled)的OpenEXR，通道为32位float的R、G、B
+bool write_exr(const Film& film, const std::string& path, int tile_size = 64);
+
+}  // namespace cray
@@ -11,19 +11,63 @@ struct Material;
 struct HitRecord {
     Point3 p;
     Vec3 normal;
-    double t;
+    Real t;
 
-    double u;
-    double v;
+    Real u;
+    Real v;
 
     std::shared_ptr<Material> mat;
 
     bool is_front_face;
 
+    // 点和外法线对表面参数(u,v)的偏导，由图元在hit中填写
+    Vec3 dpdu, dpdv;
+    Vec3 dndu, dndv;
+
+    // 一个像素在交点处覆盖的位置和UV范围，由光线微分求出
+    bool has_differentials = false;
+    Vec3 dpdx, dpdy;
+    Real dudx, dvdx, dudy, dvdy;
+
     void set_front_normal(const Ray& ray, const Vec3& outway_normal) {
         is_front_face = dot(ray.dir, outway_normal) < 0;
         normal = is_front_face ? outway_normal : -outway_normal;
     }
+
+    // 辅助光线与交点切平面求交得到dpdx、dpdy，再换算成UV的偏移
+    void compute_differentials(const Ray& ray) {
+        has_differentials = false;
+        if (!ray.has_differentials) return;
+
+        auto d = dot(normal, p);
+        auto tx = (d - dot(normal, ray.rx_origin)) / dot(normal, ray.rx_dir);
+        auto ty = (d - dot(normal, ray.ry_origin)) / dot(normal, ray.ry_dir);
+        if (!std::isfinite(tx) || !std::isfinite(ty)) return;
+        dpdx = ray.rx_origin + tx * ray.rx_dir - p;
+        dpdy = ray.ry_origin + ty * ray.ry_dir - p;
+
+        // 在法线分量最大的轴以外的两个轴上解 dp = dpdu*du + dpdv*dv
+        auto an = Vec3(std::fabs(normal.x), std::fabs(normal.y),
+                       std::fabs(normal.z));
+        int a0 = 0, a1 = 1;
+        if (an.x > an.y && an.x > an.z) {
+            a0 = 1;
+            a1 = 2;
+        } else if (an.y > an.z) {
+            a1 = 2;
+        }
+
+        auto det = dpdu[a0] * dpdv[a1] - dpdv[a0] * dpdu[a1];
+        if (std::fabs(det) < 1e-12) {
+            dudx = dvdx = dudy = dvdy = 0;
+        } else {
+            dudx = (dpdv[a1] * dpdx[a0] - dpdv[a0] * dpdx[a1]) / det;
+            dvdx = (dpdu[a0] * dpdx[a1] - dpdu[a1] * dpdx[a0]) / det;
+            dudy = (dpdv[a1] * dpdy[a0] - dpdv[a0] * dpdy[a1]) / det;
+            dvdy = (dpdu[a0] * dpdy[a1] - dpdu[a1] * dpdy[a0]) / det;
+        }
+        has_differentials = true;
+    }
 };
 
 }  // namespace cray
\ No newline at end of file
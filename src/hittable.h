@@ -4,6 +4,7 @@
 #include "interval.h"
 #include "ray.h"
 #include "aabb.h"
+#include "transform.h"
 #include "material.h"
 
 namespace cray {
@@ -16,113 +17,71 @@ public:
                      HitRecord& rec) const = 0;
 
     virtual AABB bounding_box() const = 0;
-};
-
-class Translate : public Hittable {
-public:
-    Translate(std::shared_ptr<Hittable> obj, const Vec3& offset)
-        : obj_(obj),
-          offset_(offset) {
-        aabb_ = obj_->bounding_box() + offset_;
-    }
-
-    bool hit(const Ray& ray, const Interval& interval,
-             HitRecord& rec) const override {
-        Ray offset_ray = Ray(ray.origin - offset_, ray.dir, ray.tm);
-
-        if (!obj_->hit(offset_ray, interval, rec)) return false;
-
-        rec.p += offset_;
-        return true;
-    }
-
-    AABB bounding_box() const override { return aabb_; }
 
-private:
-    std::shared_ptr<Hittable> obj_;
-    Vec3 offset_;
-    AABB aabb_;
+    // 无限大的物体(如Plane)返回false，它的包围盒不能用来构建BVH
+    virtual bool is_bounded() const { return true; }
 };
 
-class RotateY : public Hittable {
+// 仿射变换后的物体。多个Instance可以共享同一个物体(例如同一棵BVH)，
+// 以Instance为物体构造时会把变换链合并成一个矩阵
+class Instance final : public Hittable {
 public:
-    RotateY(std::shared_ptr<Hittable> p, double angle) : obj_(p) {
-        auto radians = degrees_to_radians(angle);
-        sin_theta_ = sin(radians);
-        cos_theta_ = cos(radians);
-        aabb_ = obj_->bounding_box();
-
-        Point3 min(Infinity, Infinity, Infinity);
-        Point3 max(-Infinity, -Infinity, -Infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    auto x = i * aabb_.x.max + (1 - i) * aabb_.x.min;
-                    auto y = j * aabb_.y.max + (1 - j) * aabb_.y.min;
-                    auto z = k * aabb_.z.max + (1 - k) * aabb_.z.min;
-
-                    auto newx = cos_theta_ * x + sin_theta_ * z;
-                    auto newz = -sin_theta_ * x + cos_theta_ * z;
-
-                    Vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = fmin(min[c], tester[c]);
-                        max[c] = fmax(max[c], tester[c]);
-                    }
-                }
-            }
+    Instance(std::shared_ptr<Hittable> obj, const Transform& transform) {
+        if (auto inner = dynamic_cast<const Instance*>(obj.get())) {
+            obj_ = inner->obj_;
+            object_to_world_ = transform * inner->object_to_world_;
+        } else {
+            obj_ = obj;
+            object_to_world_ = transform;
         }
-
-        aabb_ = AABB(min, max);
+        world_to_object_ = object_to_world_.inverse();
+        aabb_ = obj_->is_bounded()
+                    ? object_to_world_.bounds(obj_->bounding_box())
+                    : obj_->bounding_box();
     }
 
     bool hit(const Ray& ray, const Interval& interval,
              HitRecord& rec) const override {
-        auto origin = ray.origin;
-        auto direction = ray.dir;
-
-        origin[0] = cos_theta_ * ray.origin[0] - sin_theta_ * ray.origin[2];
-        origin[2] = sin_theta_ * ray.origin[0] + cos_theta_ * ray.origin[2];
-
-        direction[0] = cos_theta_ * ray.dir[0] - sin_theta_ * ray.dir[2];
-        direction[2] = sin_theta_ * ray.dir[0] + cos_theta_ * ray.dir[2];
-
-        Ray rotated_r(origin, direction, ray.tm);
-        if (!obj_->hit(rotated_r, interval, rec)) return false;
-
-        auto p = rec.p;
-        p[0] = cos_theta_ * rec.p[0] + sin_theta_ * rec.p[2];
-        p[2] = -sin_theta_ * rec.p[0] + cos_theta_ * rec.p[2];
-
-        auto normal = rec.normal;
-        normal[0] = cos_theta_ * rec.normal[0] + sin_theta_ * rec.normal[2];
-        normal[2] = -sin_theta_ * rec.normal[0] + cos_theta_ * rec.normal[2];
-
-        rec.p = p;
-        rec.normal = normal;
-
+        // 方向不归一化，两个空间中的t相同
+        Ray object_ray(world_to_object_.point(ray.origin),
+                       world_to_object_.vector(ray.dir), ray.tm);
+        if (!obj_->hit(object_ray, interval, rec)) return false;
+
+        // 法线用逆矩阵的转置变换，与光线方向的点积符号不变
+        rec.p = object_to_world_.point(rec.p);
+        rec.normal =
+            unit_vector(world_to_object_.transposed_vector(rec.normal));
+
+        // 光线微分在世界空间中计算，只需变换表面的偏导
+        rec.dpdu = object_to_world_.vector(rec.dpdu);
+        rec.dpdv = object_to_world_.vector(rec.dpdv);
+        rec.dndu = world_to_object_.transposed_vector(rec.dndu);
+        rec.dndv = world_to_object_.transposed_vector(rec.dndv);
         return true;
     }
 
     AABB bounding_box() const override { return aabb_; }
 
+    bool is_bounded() const override { return obj_->is_bounded(); }
+
+    const std::shared_ptr<Hittable>& object() const { return obj_; }
+    const Transform& transform() const { return object_to_world_; }
+
 private:
     std::shared_ptr<Hittable> obj_;
-    double sin_theta_;
-    double cos_theta_;
+    Transform object_to_world_;
+    Transform world_to_object_;
     AABB aabb_;
 };
 
 class ConstantMedium : public Hittable {
 public:
-    ConstantMedium(std::shared_ptr<Hittable> obj, double d,
+    ConstantMedium(std::shared_ptr<Hittable> obj, Real d,
                    std::shared_ptr<Texture> a)
         : boundary_(obj),
           neg_inv_density_(-1 / d),
           mat_(std::make_shared<Isotropic>(a)) {}
-    ConstantMedium(std::shared_ptr<Hittable> obj, double d, Color c)
+    ConstantMedium(std::shared_ptr<Hittable> obj, Real d, Color c)
         : boundary_(obj),
           neg_inv_density_(-1 / d),
           mat_(std::make_shared<Isotropic>(c)) {}
@@ -146,7 +105,7 @@ public:
 
         auto ray_length = ray.dir.length();
         auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-        auto hit_distance = neg_inv_density_ * log(random_double());
+        auto hit_distance = neg_inv_density_ * std::log(random_double());
 
         if (hit_distance > distance_inside_boundary) return false;
 
@@ -156,6 +115,8 @@ public:
         rec.normal = Vec3(1, 0, 0);
         rec.is_front_face = true;
         rec.mat = mat_;
+        rec.dpdu = rec.dpdv = Vec3(0, 0, 0);
+        rec.dndu = rec.dndv = Vec3(0, 0, 0);
 
         return true;
     }
@@ -164,7 +125,7 @@ public:
 
 private:
     std::shared_ptr<Hittable> boundary_;
-    double neg_inv_density_;
+    Real neg_inv_density_;
     std::shared_ptr<Material> mat_;
 };
 
@@ -13,7 +13,10 @@ public:
 
     void add(std::shared_ptr<Hittable> obj) {
         objects.push_back(obj);
-        aabb = AABB(aabb, obj->bounding_box());
+        if (obj->is_bounded())
+            aabb = AABB(aabb, obj->bounding_box());
+        else
+            bounded = false;
     }
 
     void clear() { objects.clear(); }
@@ -21,11 +24,15 @@ public:
     bool hit(const Ray& ray, const Interval& interval,
              HitRecord& rec) const override;
 
+    // 只包含有界物体的包围盒
     AABB bounding_box() const override { return aabb; }
 
+    bool is_bounded() const override { return bounded; }
+
     std::vector<std::shared_ptr<Hittable>> objects;
 
     AABB aabb;
+    bool bounded = true;
 };
 
 }  // namespace cray
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "image_registry.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace cray {
+
+// FNV-1a，用于识别内容相同的文件
+static uint64_t content_hash(const void* data, size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+ImageRegistry::Handle ImageRegistry::load(const std::string& path,
+                                          TexFormat format) {
+    using clock = std::chrono::steady_clock;
+
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(path, ec);
+    auto key = ec ? path : canonical.string();
+    bool container = std::filesystem::path(path).extension() == ".ctex";
+    if (!container) key += std::string("#") + tex_format_name(format);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (requests_++ == 0) first_request_ = clock::now();
+        auto it = by_path_.find(key);
+        if (it != by_path_.end()) {
+            auto& entry = by_hash_[it->second];
+            entry.users++;
+            return entry.handle;
+        }
+    }
+
+    // 纹理容器直接映射，不读取整个文件，按路径去重
+    if (container) {
+        std::promise<std::shared_ptr<const MipMap>> mapped;
+        mapped.set_value(MipMap::map(path));
+        auto hash = content_hash(key.data(), key.size());
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_done_ = std::max(last_done_, clock::now());
+        by_path_[key] = hash;
+        auto& entry = by_hash_[hash];
+        if (entry.users++ == 0) entry.handle = mapped.get_future().share();
+        return entry.handle;
+    }
+
+    // 只登记，deferred的future在第一次get()时于调用线程上执行load_lazy，
+    // 并发的get()等待同一次执行完成
+    if (lazy_) {
+        auto id = content_hash(key.data(), key.size());
+        std::lock_guard<std::mutex> lock(mutex_);
+        by_path_[key] = id;
+        auto& entry = by_hash_[id];
+        if (entry.users++ == 0) {
+            entry.path = path;
+            entry.lazy = true;
+            entry.handle = std::async(std::launch::deferred,
+                                      [this, id, path, format] {
+                                          return load_lazy(id, path, format);
+                                      })
+                               .share();
+        }
+        return entry.handle;
+    }
+
+    // 读文件在调用线程上进行，只有解码交给后台线程
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+    if (!file.is_open() || bytes.empty()) {
+        std::promise<std::shared_ptr<const MipMap>> missing;
+        missing.set_value(std::make_shared<const MipMap>());
+        return missing.get_future().share();
+    }
+    auto hash = hash_values(content_hash(bytes.data(), bytes.size()),
+                            static_cast<uint32_t>(format));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    by_path_[key] = hash;
+    auto& entry = by_hash_[hash];
+    if (entry.users++ > 0) return entry.handle;
+
+    auto promise =
+        std::make_shared<std::promise<std::shared_ptr<const MipMap>>>();
+    entry.handle = promise->get_future().share();
+    jobs_.push_back([this, promise, format, bytes = std::move(bytes)] {
+        auto start = clock::now();
+        auto mip = std::make_shared<const MipMap>(
+            CRayImage(bytes.data(), bytes.size()), format);
+        auto end = clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decode_seconds_ +=
+                std::chrono::duration<double>(end - start).count();
+            last_done_ = std::max(last_done_, end);
+        }
+        promise->set_value(std::move(mip));
+    });
+
+    int max_threads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (running_ < max_threads) {
+        running_++;
+        threads_.emplace_back(&ImageRegistry::run_jobs, this);
+    }
+    return entry.handle;
+}
+
+std::shared_ptr<const MipMap> ImageRegistry::load_lazy(
+    uint64_t id, const std::string& path, TexFormat format) {
+    using clock = std::chrono::steady_clock;
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+    auto hash = hash_values(content_hash(bytes.data(), bytes.size()),
+                            static_cast<uint32_t>(format));
+
+    // 内容相同的图像已经或正在加载时，等待那一次的结果
+    Handle loaded;
+    std::promise<std::shared_ptr<const MipMap>> promise;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = by_content_.find(hash);
+        if (it != by_content_.end())
+            loaded = it->second;
+        else
+            by_content_[hash] = promise.get_future().share();
+    }
+    if (loaded.valid()) {
+        auto mip = loaded.get();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = by_hash_[id];
+        entry.touched = true;
+        entry.content_shared = true;
+        return mip;
+    }
+
+    auto start = clock::now();
+    auto mip = bytes.empty() ? std::make_shared<const MipMap>()
+                             : std::make_shared<const MipMap>(
+                                   CRayImage(bytes.data(), bytes.size()),
+                                   format);
+    auto end = clock::now();
+    promise.set_value(mip);
+    std::lock_guard<std::mutex> lock(mutex_);
+    decode_seconds_ += std::chrono::duration<double>(end - start).count();
+    last_done_ = std::max(last_done_, end);
+    by_hash_[id].touched = true;
+    return mip;
+}
+
+void ImageRegistry::run_jobs() {
+    // 队列为空时线程退出，wait()之后不留下空闲线程，fork出的进程也是安全的
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!jobs_.empty()) {
+        auto job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+    running_--;
+}
+
+void ImageRegistry::wait() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads.swap(threads_);
+    }
+    for (auto& t : threads) t.join();
+}
+
+ImageRegistry::Stats ImageRegistry::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.requests = requests_;
+    stats.images = by_hash_.size();
+    for (const auto& [hash, entry] : by_hash_) {
+        stats.shared += entry.users - 1;
+        // 未查询过的延迟图像不能get()，否则会在这里加载
+        if (entry.lazy && !entry.touched) {
+            stats.untouched.push_back(entry.path);
+            continue;
+        }
+        auto bytes = entry.handle.get()->memory_bytes();
+        stats.saved_bytes += (entry.users - 1) * bytes;
+        if (entry.content_shared) {
+            stats.shared++;
+            stats.saved_bytes += bytes;
+        } else {
+            stats.decodes++;
+            stats.image_bytes += bytes;
+        }
+    }
+    std::sort(stats.untouched.begin(), stats.untouched.end());
+    stats.decode_seconds = decode_seconds_;
+    if (stats.decodes > 0)
+        stats.load_seconds =
+            std::chrono::duration<double>(last_done_ - first_request_)
+                .count();
+    return stats;
+}
+
+ImageRegistry& image_registry() {
+    static ImageRegistry registry;
+    return registry;
+}
+
+}  // namespace cray
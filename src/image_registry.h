@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "mipmap.h"
+
+namespace cray {
+
+// 场景加载时共享解码后的图像。路径相同或文件内容相同的图像只解码一次，
+// 解码放到后台线程并行进行，load()立即返回。.ctex纹理容器直接映射，不需要解码。
+// 延迟模式下load()只登记路径，第一次查询时才在查询线程上读文件和解码，
+// 同时查询的其他线程等待，相机看不到的纹理不占用启动时间和内存
+class ImageRegistry {
+public:
+    using Handle = std::shared_future<std::shared_ptr<const MipMap>>;
+
+    ~ImageRegistry() { wait(); }
+
+    // 之后的load()是否延迟到第一次查询，应在构建场景之前设置
+    void set_lazy(bool lazy) { lazy_ = lazy; }
+
+    // 读取文件并按内容去重，未解码过的交给后台线程。
+    // 同一图像以不同格式加载时各存一份，.ctex使用容器自己的格式。
+    // 文件不存在时得到空的MipMap
+    Handle load(const std::string& path, TexFormat format = TexFormat::Auto);
+    // 等待所有解码完成，回收后台线程
+    void wait();
+
+    struct Stats {
+        size_t requests = 0;
+        size_t images = 0;   // 不同的路径和格式
+        size_t decodes = 0;  // 实际解码或映射的图像
+        size_t shared = 0;          // 复用已有图像的请求数
+        size_t saved_bytes = 0;     // 复用省下的mip金字塔内存
+        size_t image_bytes = 0;     // 各图像的mip金字塔内存之和
+        double decode_seconds = 0;  // 各线程解码时间之和
+        double load_seconds = 0;    // 第一次请求到最后一张解码完成
+        std::vector<std::string> untouched;  // 延迟加载且从未被查询的图像
+    };
+    // 应在wait()之后调用，延迟模式下在渲染结束后调用
+    Stats stats() const;
+
+private:
+    struct Entry {
+        Handle handle;
+        size_t users = 0;
+        std::string path;
+        bool lazy = false;
+        bool touched = false;         // 延迟加载的图像已完成加载
+        bool content_shared = false;  // 与先加载的图像内容相同，未解码
+    };
+
+    void run_jobs();
+    // 延迟加载的图像第一次被查询时调用
+    std::shared_ptr<const MipMap> load_lazy(uint64_t id,
+                                            const std::string& path,
+                                            TexFormat format);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, uint64_t> by_path_;  // 路径到内容hash
+    std::unordered_map<uint64_t, Entry> by_hash_;
+    // 延迟模式下按内容去重，键与by_hash_相同，为内容hash加格式
+    std::unordered_map<uint64_t, Handle> by_content_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> threads_;
+    int running_ = 0;
+    bool lazy_ = false;
+
+    size_t requests_ = 0;
+    double decode_seconds_ = 0;
+    std::chrono::steady_clock::time_point first_request_, last_done_;
+};
+
+ImageRegistry& image_registry();
+
+}  // namespace cray
@@ -1,43 +1,44 @@
 #pragma once
 
+#include <cmath>
 #include "common.h"
 
 namespace cray {
 
 struct Interval {
     Interval() : min(+Infinity), max(-Infinity) {}
-    Interval(double min_v, double max_v) : min(min_v), max(max_v) {}
+    Interval(Real min_v, Real max_v) : min(min_v), max(max_v) {}
     Interval(const Interval& a, const Interval& b)
-        : min(fmin(a.min, b.min)),
-          max(fmax(a.max, b.max)) {}
+        : min(std::fmin(a.min, b.min)),
+          max(std::fmax(a.max, b.max)) {}
 
-    bool contains(double x) const { return min <= x && x <= max; }
+    bool contains(Real x) const { return min <= x && x <= max; }
 
-    bool surrounds(double x) const { return min < x && x < max; }
+    bool surrounds(Real x) const { return min < x && x < max; }
 
-    double clamp(double x) const {
+    Real clamp(Real x) const {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
 
-    double size() const { return max - min; }
+    Real size() const { return max - min; }
 
-    Interval expand(double delta) const {
+    Interval expand(Real delta) const {
         auto padding = delta / 2.0;
         return Interval(min - padding, max + padding);
     }
 
     static const Interval empty, universe;
 
-    double min, max;
+    Real min, max;
 };
 
-inline Interval operator+(const Interval& ival, double displacement) {
+inline Interval operator+(const Interval& ival, Real displacement) {
     return Interval(ival.min + displacement, ival.max + displacement);
 }
 
-inline Interval operator+(double displacement, const Interval& ival) {
+inline Interval operator+(Real displacement, const Interval& ival) {
     return ival + displacement;
 }
 
@@ -1,39 +1,155 @@
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include "material.h"
 #include "camera.h"
 #include "shapes.h"
 #include "hittable_list.h"
 #include "bvh.h"
+#include "tlas.h"
 #include "texture.h"
+#include "image_registry.h"
+#include "texture_cache.h"
+#include "distributed.h"
+#include "tone_map.h"
 
 using namespace cray;
 
-std::shared_ptr<HittableList> box(const Point3& a, const Point3& b,
-                                  std::shared_ptr<Material> mat) {
-    auto sides = std::make_shared<HittableList>();
-
-    auto min = Point3(fmin(a.x, b.x), fmin(a.y, b.y), fmin(a.z, b.z));
-    auto max = Point3(fmax(a.x, b.x), fmax(a.y, b.y), fmax(a.z, b.z));
-
-    auto dx = Vec3(max.x - min.x, 0, 0);
-    auto dy = Vec3(0, max.y - min.y, 0);
-    auto dz = Vec3(0, 0, max.z - min.z);
-
-    sides->add(std::make_shared<Quad>(Point3(min.x, min.y, max.z), dx, dy,
-                                      mat));  // front
-    sides->add(std::make_shared<Quad>(Point3(max.x, min.y, max.z), -dz, dy,
-                                      mat));  // right
-    sides->add(std::make_shared<Quad>(Point3(max.x, min.y, min.z), -dx, dy,
-                                      mat));  // back
-    sides->add(std::make_shared<Quad>(Point3(min.x, min.y, min.z), dz, dy,
-                                      mat));  // left
-    sides->add(std::make_shared<Quad>(Point3(min.x, max.y, max.z), dx, -dz,
-                                      mat));  // top
-    sides->add(std::make_shared<Quad>(Point3(min.x, min.y, min.z), dx, dz,
-                                      mat));  // bottom
-
-    return sides;
+// 命令行参数，非零/非空的值覆盖场景里的相机设置
+struct Options {
+    std::string scene = "book1";
+    std::string output;
+    int width = 0;
+    int spp = 0;
+    int depth = 0;
+    SamplerType sampler = SamplerType::Independent;
+    int seed = -1;
+    int threads = 0;
+    bool ray_differentials = true;
+    double texture_cache_mb = 0;  // 纹理tile缓存的预算，0表示纹理全部常驻内存
+    double bake_spacing = 0;  // 噪声纹理烘焙成网格的间距，0表示不烘焙
+    TexFormat tex_format = TexFormat::Auto;  // 图像纹理的存储格式
+    bool lazy_textures = true;  // 图像纹理在第一次查询时才解码
+    std::string env;            // 环境贴图，代替场景的背景颜色
+    double env_scale = 1;
+    bool env_mis = true;
+
+    std::string checkpoint;
+    double checkpoint_interval = 0;
+    double time_budget = 0;
+    std::string preview;
+
+    bool motion_bvh = false;  // 运动模糊场景使用带运动包围盒的BVH
+
+    int frames = 100;
+    std::string bvh_update = "refit";  // 动画每帧的BVH更新方式
+
+    int worker_port = 0;  // 作为worker监听的端口
+    DistributedOptions dist;
+};
+
+static Options options;
+
+void apply_options(Camera& cam) {
+    if (options.width > 0) cam.image_width = options.width;
+    if (options.spp > 0) cam.samples_per_pixel = options.spp;
+    if (options.depth > 0) cam.max_depth = options.depth;
+    cam.sampler_type = options.sampler;
+    if (options.seed >= 0) cam.seed = options.seed;
+    if (options.threads > 0) cam.threads = options.threads;
+    cam.ray_differentials = options.ray_differentials;
+    cam.checkpoint_path = options.checkpoint;
+    if (options.checkpoint_interval > 0)
+        cam.checkpoint_interval = options.checkpoint_interval;
+    cam.time_budget = options.time_budget;
+    cam.preview_path = options.preview;
+    if (!options.env.empty()) {
+        auto env =
+            std::make_shared<EnvironmentLight>(options.env, options.env_scale);
+        // 读取失败时保留场景原有的背景，不渲染成全黑
+        if (env->empty())
+            std::clog << "cannot read " << options.env
+                      << ", using background\n";
+        else
+            cam.environment = env;
+    }
+    cam.environment_mis = options.env_mis;
+}
+
+void render_scene(Camera& cam, const Hittable& world,
+                  const std::string& output) {
+    apply_options(cam);
+
+    image_registry().wait();
+
+    // worker与coordinator各自构建同一个场景，场景中的随机数序列一致
+    if (options.worker_port > 0) {
+        serve_worker(cam, world, options.worker_port);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Film film;
+    bool distributed =
+        options.dist.local_workers > 0 || !options.dist.workers.empty();
+    if (distributed) {
+        render_distributed(cam, world, film, options.dist);
+    } else {
+        cam.render(world, film);
+    }
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    std::clog << "render: " << seconds << " s ("
+              << (sizeof(Real) == sizeof(float) ? "float" : "double")
+              << ")\n";
+
+    // 延迟加载的图像在渲染中才解码，渲染结束后统计。
+    // 分布式渲染时解码发生在worker进程中，这里的统计不完整
+    auto images = image_registry().stats();
+    if (images.requests > 0) {
+        std::clog << "images: " << images.requests << " requests, "
+                  << images.decodes << "/" << images.images
+                  << " decoded in " << images.load_seconds << " s ("
+                  << images.decode_seconds << " s decode), "
+                  << images.shared << " shared, "
+                  << images.image_bytes / 1024 << " KiB resident, "
+                  << images.saved_bytes / 1024 << " KiB saved\n";
+        if (!distributed) {
+            for (const auto& path : images.untouched)
+                std::clog << "  never sampled: " << path << "\n";
+        }
+    }
+    if (texture_cache().enabled()) {
+        auto stats = texture_cache().stats();
+        std::clog << "texture cache: " << stats.hits << " hits, "
+                  << stats.misses << " misses, " << stats.evictions
+                  << " evictions, peak " << stats.peak_bytes / 1024
+                  << " KiB\n";
+    }
+
+    save_image(film, options.output.empty() ? output : options.output);
+}
+
+// 设置了--bake-spacing时把纹理烘焙为bounds内的网格，并输出与原纹理的误差
+std::shared_ptr<Texture> bake_texture(std::shared_ptr<Texture> tex,
+                                      const AABB& bounds, const char* name) {
+    if (options.bake_spacing <= 0) return tex;
+
+    auto start = std::chrono::steady_clock::now();
+    auto baked = std::make_shared<BakedTex>(tex, bounds, options.bake_spacing);
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    auto error = baked->measure_error(100000);
+    std::clog << "baked " << name << ": " << baked->nx << "x" << baked->ny
+              << "x" << baked->nz << ", " << baked->memory_bytes() / 1024
+              << " KiB in " << seconds << " s, error rms " << error.rms_error
+              << " max " << error.max_error << "\n";
+    return baked;
 }
 
 void render_book1_world(int width, int per_sample, int max_depth) {
@@ -43,8 +159,8 @@ void render_book1_world(int width, int per_sample, int max_depth) {
                                             Color(.9, .9, .9));
 
     auto ground_material = std::make_shared<Lambertian>(tex);
-    world.add(
-        std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0),
+                                      ground_material));
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
@@ -105,12 +221,13 @@ void render_book1_world(int width, int per_sample, int max_depth) {
 
     cam.background = Color(0.70, 0.80, 1.00);
 
-    cam.render_to_png(world, "data/book01.png");
+    render_scene(cam, world, "data/book01.png");
 }
 
 void render_earth() {
     std::string path = "data/earthmap.jpg";
-    auto earth_texture = std::make_shared<ImageTex>(path);
+    auto earth_texture =
+        std::make_shared<ImageTex>(path, TexFilter::EWA, options.tex_format);
     auto earth_surface = std::make_shared<Lambertian>(earth_texture);
     auto globe = std::make_shared<Sphere>(Point3(0, 0, 0), 2, earth_surface);
 
@@ -130,17 +247,21 @@ void render_earth() {
 
     cam.background = Color(0.70, 0.80, 1.00);
 
-    cam.render_to_png(HittableList(globe), "data/earth.png");
+    render_scene(cam, HittableList(globe), "data/earth.png");
 }
 
 void render_noise() {
     HittableList world;
 
     auto pertext = std::make_shared<NoiseTex>(4);
-    world.add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000,
-                                       make_shared<Lambertian>(pertext)));
+    auto ground_tex = bake_texture(
+        pertext, AABB(Point3(-8, 0, -8), Point3(8, 0, 8)), "ground");
+    auto sphere_tex = bake_texture(
+        pertext, AABB(Point3(-2, 0, -2), Point3(2, 4, 2)), "sphere");
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0),
+                                      make_shared<Lambertian>(ground_tex)));
     world.add(std::make_shared<Sphere>(Point3(0, 2, 0), 2,
-                                       make_shared<Lambertian>(pertext)));
+                                       make_shared<Lambertian>(sphere_tex)));
 
     Camera cam;
 
@@ -158,7 +279,7 @@ void render_noise() {
 
     cam.background = Color(0.70, 0.80, 1.00);
 
-    cam.render_to_png(world, "data/noise.png");
+    render_scene(cam, world, "data/noise.png");
 }
 
 void render_quads() {
@@ -199,17 +320,21 @@ void render_quads() {
 
     cam.background = Color(0.70, 0.80, 1.00);
 
-    cam.render_to_png(world, "data/quad.png");
+    render_scene(cam, world, "data/quad.png");
 }
 
 void render_simple_light() {
     HittableList world;
 
     auto pertext = std::make_shared<NoiseTex>(4);
-    world.add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000,
-                                       make_shared<Lambertian>(pertext)));
+    auto ground_tex = bake_texture(
+        pertext, AABB(Point3(-8, 0, -8), Point3(8, 0, 8)), "ground");
+    auto sphere_tex = bake_texture(
+        pertext, AABB(Point3(-2, 0, -2), Point3(2, 4, 2)), "sphere");
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0),
+                                      make_shared<Lambertian>(ground_tex)));
     world.add(std::make_shared<Sphere>(Point3(0, 2, 0), 2,
-                                       make_shared<Lambertian>(pertext)));
+                                       make_shared<Lambertian>(sphere_tex)));
 
     auto difflight = std::make_shared<DiffuseLight>(Color(4, 4, 4));
     world.add(std::make_shared<Quad>(Point3(3, 1, -2), Vec3(2, 0, 0),
@@ -230,7 +355,7 @@ void render_simple_light() {
 
     cam.defocus_angle = 0;
 
-    cam.render_to_png(world, "data/simple_light.png");
+    render_scene(cam, world, "data/simple_light.png");
 }
 
 void render_cornell_box() {
@@ -255,15 +380,17 @@ void render_cornell_box() {
                                      Vec3(0, 555, 0), white));
 
     std::shared_ptr<Hittable> box1 =
-        box(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = std::make_shared<RotateY>(box1, 15);
-    box1 = std::make_shared<Translate>(box1, Vec3(265, 0, 295));
+        std::make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = std::make_shared<Instance>(box1, Transform::rotate_y(15));
+    box1 = std::make_shared<Instance>(
+        box1, Transform::translate(Vec3(265, 0, 295)));
     world.add(box1);
 
     std::shared_ptr<Hittable> box2 =
-        box(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = std::make_shared<RotateY>(box2, -18);
-    box2 = std::make_shared<Translate>(box2, Vec3(130, 0, 65));
+        std::make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = std::make_shared<Instance>(box2, Transform::rotate_y(-18));
+    box2 = std::make_shared<Instance>(
+        box2, Transform::translate(Vec3(130, 0, 65)));
     world.add(box2);
 
     Camera cam;
@@ -281,7 +408,7 @@ void render_cornell_box() {
 
     cam.defocus_angle = 0;
 
-    cam.render_to_png(world, "data/cornell_box.png");
+    render_scene(cam, world, "data/cornell_box.png");
 }
 
 void render_cornell_smoke() {
@@ -306,14 +433,16 @@ void render_cornell_smoke() {
                                      Vec3(0, 555, 0), white));
 
     std::shared_ptr<Hittable> box1 =
-        box(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = std::make_shared<RotateY>(box1, 15);
-    box1 = std::make_shared<Translate>(box1, Vec3(265, 0, 295));
+        std::make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = std::make_shared<Instance>(box1, Transform::rotate_y(15));
+    box1 = std::make_shared<Instance>(
+        box1, Transform::translate(Vec3(265, 0, 295)));
 
     std::shared_ptr<Hittable> box2 =
-        box(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = std::make_shared<RotateY>(box2, -18);
-    box2 = std::make_shared<Translate>(box2, Vec3(130, 0, 65));
+        std::make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = std::make_shared<Instance>(box2, Transform::rotate_y(-18));
+    box2 = std::make_shared<Instance>(
+        box2, Transform::translate(Vec3(130, 0, 65)));
 
     world.add(std::make_shared<ConstantMedium>(box1, 0.01, Color(0, 0, 0)));
     world.add(std::make_shared<ConstantMedium>(box2, 0.01, Color(1, 1, 1)));
@@ -333,7 +462,7 @@ void render_cornell_smoke() {
 
     cam.defocus_angle = 0;
 
-    cam.render_to_png(world, "data/cornell_smoke.png");
+    render_scene(cam, world, "data/cornell_smoke.png");
 }
 
 void render_book2_scene(int image_width, int samples_per_pixel, int max_depth) {
@@ -351,7 +480,8 @@ void render_book2_scene(int image_width, int samples_per_pixel, int max_depth) {
             auto y1 = random_double(1, 101);
             auto z1 = z0 + w;
 
-            boxes1.add(box(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+            boxes1.add(std::make_shared<Box>(Point3(x0, y0, z0),
+                                             Point3(x1, y1, z1), ground));
         }
     }
 
@@ -384,10 +514,12 @@ void render_book2_scene(int image_width, int samples_per_pixel, int max_depth) {
     world.add(
         std::make_shared<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
 
-    auto emat = std::make_shared<Lambertian>(
-        std::make_shared<ImageTex>("data/earthmap.jpg"));
+    auto emat = std::make_shared<Lambertian>(std::make_shared<ImageTex>(
+        "data/earthmap.jpg", TexFilter::EWA, options.tex_format));
     world.add(std::make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
-    auto pertext = std::make_shared<NoiseTex>(0.1);
+    auto pertext = bake_texture(
+        std::make_shared<NoiseTex>(0.1),
+        AABB(Point3(140, 200, 220), Point3(300, 360, 380)), "noise sphere");
     world.add(std::make_shared<Sphere>(Point3(220, 280, 300), 80,
                                        std::make_shared<Lambertian>(pertext)));
 
@@ -398,9 +530,9 @@ void render_book2_scene(int image_width, int samples_per_pixel, int max_depth) {
         boxes2.add(std::make_shared<Sphere>(Point3::random(0, 165), 10, white));
     }
 
-    world.add(std::make_shared<Translate>(
-        std::make_shared<RotateY>(std::make_shared<BVHNode>(boxes2), 15),
-        Vec3(-100, 270, 395)));
+    world.add(std::make_shared<Instance>(
+        std::make_shared<BVHNode>(boxes2),
+        Transform::translate(Vec3(-100, 270, 395)) * Transform::rotate_y(15)));
 
     Camera cam;
 
@@ -417,10 +549,445 @@ void render_book2_scene(int image_width, int samples_per_pixel, int max_depth) {
 
     cam.defocus_angle = 0;
 
-    cam.render_to_png(world, "data/book2_scene.png");
+    render_scene(cam, world, "data/book2_scene.png");
+}
+
+// 比较两张PFM，用于评估不同精度/采样方式带来的误差
+int compare_images(const std::string& a, const std::string& b) {
+    Film fa, fb;
+    if (!read_pfm(a, fa) || !read_pfm(b, fb)) {
+        std::clog << "cannot read pfm\n";
+        return 1;
+    }
+    if (fa.width() != fb.width() || fa.height() != fb.height()) {
+        std::clog << "image size mismatch\n";
+        return 1;
+    }
+
+    double sum_sq = 0, max_err = 0, peak = 0;
+    for (int j = 0; j < fa.height(); ++j) {
+        for (int i = 0; i < fa.width(); ++i) {
+            auto ca = fa.pixel(i, j), cb = fb.pixel(i, j);
+            for (int n = 0; n < 3; ++n) {
+                auto d = fabs(ca[n] - cb[n]);
+                sum_sq += d * d;
+                max_err = fmax(max_err, d);
+                peak = fmax(peak, ca[n]);
+            }
+        }
+    }
+    auto mse = sum_sq / (3.0 * fa.width() * fa.height());
+    std::cout << "rmse " << sqrt(mse) << "  max " << max_err << "  psnr "
+              << (mse > 0 ? 10 * log10(peak * peak / mse) : Infinity)
+              << " dB\n";
+    return 0;
+}
+
+// 把图像转换为纹理容器，渲染时直接映射，不需要解码和生成mip
+int convert_texture(const std::string& input, const std::string& output,
+                    TexFormat format) {
+    auto start = std::chrono::steady_clock::now();
+    CRayImage image(input);
+    if (image.invalid()) {
+        std::clog << "cannot read " << input << "\n";
+        return 1;
+    }
+    MipMap mip(image, format);
+    if (!mip.save(output)) {
+        std::clog << "cannot write " << output << "\n";
+        return 1;
+    }
+    auto seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    std::clog << input << " -> " << output << ": " << mip.width(0) << "x"
+              << mip.height(0) << ", " << mip.levels() << " levels, "
+              << tex_format_name(mip.format()) << ", "
+              << mip.memory_bytes() / 1024 << " KiB, " << seconds << " s\n";
+    return 0;
+}
+
+// 程序生成的天空：地平线到天顶的渐变、暗色的地面和一个很小很亮的太阳
+std::shared_ptr<const MipMap> make_sky(int width, int height) {
+    auto sun = unit_vector(Vec3(-0.6, 0.55, 0.6));
+    const Real sun_cos = std::cos(degrees_to_radians(1.5));
+    std::vector<float> rgb(3 * static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y) {
+        auto theta = PI * (y + 0.5) / height;
+        for (int x = 0; x < width; ++x) {
+            auto phi = 2 * PI * (x + 0.5) / width;
+            Vec3 dir(-std::cos(phi) * std::sin(theta), std::cos(theta),
+                     std::sin(phi) * std::sin(theta));
+            Color c;
+            if (dot(dir, sun) > sun_cos) {
+                c = 1000 * Color(1, 0.95, 0.85);
+            } else if (dir.y > 0) {
+                auto a = std::sqrt(dir.y);
+                c = (1 - a) * Color(0.8, 0.85, 0.9) +
+                    a * Color(0.2, 0.35, 0.75);
+            } else {
+                c = Color(0.12, 0.11, 0.1);
+            }
+            auto dst = rgb.data() + 3 * (static_cast<size_t>(y) * width + x);
+            for (int i = 0; i < 3; ++i) dst[i] = static_cast<float>(c[i]);
+        }
+    }
+    return std::make_shared<const MipMap>(
+        CRayImage(width, height, rgb.data()), TexFormat::Half);
+}
+
+// 环境光照明的室外场景，--env指定环境贴图时使用该贴图
+void render_sky() {
+    HittableList world;
+    world.add(std::make_shared<Plane>(
+        Point3(0, 0, 0), Vec3(0, 1, 0),
+        std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+    world.add(std::make_shared<Sphere>(
+        Point3(-4, 1, 0), 1.0,
+        std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1))));
+    world.add(std::make_shared<Sphere>(Point3(0, 1, 0), 1.0,
+                                       std::make_shared<Dielectric>(1.5)));
+    world.add(std::make_shared<Sphere>(
+        Point3(4, 1, 0), 1.0,
+        std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.2)));
+
+    Camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth = 20;
+
+    cam.fov = 30;
+    cam.position = Point3(6, 3, 12);
+    cam.look_at = Point3(0, 0.8, 0);
+    cam.up = Vec3(0, 1, 0);
+
+    cam.environment = std::make_shared<EnvironmentLight>(make_sky(1024, 512));
+
+    render_scene(cam, world, "data/sky.png");
 }
 
-int main() {
-    render_book1_world(1200, 500, 50);
-    // render_book2_scene(400, 250, 4);
-}
\ No newline at end of file
+// 同一簇1000个球的64个实例：底层BVH只构建一次，顶层BVH只包含实例
+void render_instances() {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - t)
+            .count();
+    };
+
+    HittableList cluster;
+    auto white = std::make_shared<Lambertian>(Color(.73, .73, .73));
+    for (int j = 0; j < 1000; j++) {
+        cluster.add(
+            std::make_shared<Sphere>(Point3::random(-80, 80), 10, white));
+    }
+    auto start = Clock::now();
+    auto blas = std::make_shared<BVHNode>(cluster);
+    auto blas_ms = ms(start);
+
+    TopLevelBVH world;
+    auto ground = std::make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+    world.add(std::make_shared<Quad>(Point3(-1000, 0, -600), Vec3(2000, 0, 0),
+                                     Vec3(0, 0, 2400), ground));
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 8; k++) {
+            world.add(blas, Transform::translate(
+                                Vec3(i * 220 - 770, 90, k * 220)) *
+                                Transform::rotate_y(random_double(0, 360)));
+        }
+    }
+    start = Clock::now();
+    world.build();
+    auto tlas_ms = ms(start);
+
+    // 移动一个实例只需要重建顶层
+    start = Clock::now();
+    world.set_transform(1, Transform::translate(Vec3(-770, 250, 0)));
+    world.build();
+    auto move_ms = ms(start);
+
+    auto instances = world.size() - 1;
+    std::clog << "instances: " << instances << " x " << cluster.objects.size()
+              << " spheres, blas " << blas->memory_bytes() / 1024
+              << " KiB built in " << blas_ms << " ms, tlas "
+              << world.memory_bytes() / 1024 << " KiB built in " << tlas_ms
+              << " ms, move+rebuild " << move_ms << " ms (flattened: ~"
+              << instances * blas->memory_bytes() / 1024 << " KiB)\n";
+
+    Camera cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 50;
+    cam.max_depth = 8;
+    cam.background = Color(0.70, 0.80, 1.00);
+
+    cam.fov = 50;
+    cam.position = Point3(0, 700, -900);
+    cam.look_at = Point3(0, 0, 600);
+    cam.up = Vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    render_scene(cam, world, "data/instances.png");
+}
+
+// 大量快速运动的球，运动范围远大于球本身
+void render_motion_blur() {
+    HittableList spheres;
+    for (int a = -20; a < 20; a++) {
+        for (int b = -20; b < 20; b++) {
+            Point3 center(a + 0.9 * random_double(), 0.2,
+                          b + 0.9 * random_double());
+            auto offset = Vec3(random_double(-2, 2), random_double(0, 1.5),
+                               random_double(-2, 2));
+            auto albedo = Color::random() * Color::random();
+            spheres.add(std::make_shared<Sphere>(
+                center, center + offset, 0.2,
+                std::make_shared<Lambertian>(albedo)));
+        }
+    }
+
+    HittableList world;
+    auto ground = std::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    world.add(
+        std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0), ground));
+    world.add(std::make_shared<BVHNode>(spheres, options.motion_bvh));
+
+    Camera cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 32;
+    cam.max_depth = 8;
+    cam.background = Color(0.70, 0.80, 1.00);
+
+    cam.fov = 50;
+    cam.position = Point3(0, 10, -26);
+    cam.look_at = Point3(0, 0, 0);
+    cam.up = Vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    render_scene(cam, world, "data/motion_blur.png");
+}
+
+// 逐帧动画：一团球向外飞散，每帧移动图元、更新BVH后渲染。
+// --bvh-update选择每帧完全重建(rebuild)、只refit(refit-only)或
+// refit并在SAH代价变差时重建(refit)
+void render_animation() {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point t) {
+        return std::chrono::duration<double>(Clock::now() - t).count();
+    };
+
+    HittableList objs;
+    for (int j = 0; j < 2000; j++) {
+        auto albedo = Color::random() * Color::random();
+        objs.add(std::make_shared<Sphere>(60 * random_in_unit_sphere(), 4,
+                                          std::make_shared<Lambertian>(albedo)));
+    }
+    auto world = std::make_shared<BVHNode>(objs);
+
+    auto& spheres = world->primitives().spheres();
+    std::vector<Point3> start;
+    std::vector<Vec3> velocity;
+    for (auto& sphere : spheres) {
+        start.push_back(sphere.center);
+        velocity.push_back(250 * random_in_unit_sphere());
+    }
+
+    Camera cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 160;
+    cam.samples_per_pixel = 4;
+    cam.max_depth = 8;
+    cam.background = Color(0.70, 0.80, 1.00);
+
+    cam.fov = 40;
+    cam.position = Point3(0, 150, -900);
+    cam.look_at = Point3(0, 0, 0);
+    cam.up = Vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    apply_options(cam);
+
+    double update_seconds = 0, render_seconds = 0, sah_sum = 0;
+    int rebuilds = 0;
+    for (int frame = 0; frame < options.frames; ++frame) {
+        auto t = options.frames > 1 ? Real(frame) / (options.frames - 1) : 0;
+
+        auto update_start = Clock::now();
+        for (size_t i = 0; i < spheres.size(); ++i) {
+            spheres[i].move_to(start[i] + t * velocity[i]);
+        }
+        if (options.bvh_update == "rebuild") {
+            world->rebuild();
+            rebuilds++;
+        } else if (options.bvh_update == "refit-only") {
+            world->refit();
+        } else {
+            rebuilds += world->update();
+        }
+        update_seconds += seconds(update_start);
+        sah_sum += world->sah_cost();
+
+        auto render_start = Clock::now();
+        Film film;
+        cam.render(*world, film);
+        render_seconds += seconds(render_start);
+
+        if (!options.output.empty()) {
+            // 帧号插在扩展名之前，没有扩展名时加在末尾。
+            // 最后一个'/'之前的'.'属于目录名
+            const auto& path = options.output;
+            auto dot = path.rfind('.');
+            auto slash = path.rfind('/');
+            if (dot != std::string::npos && slash != std::string::npos &&
+                dot < slash)
+                dot = std::string::npos;
+            if (dot == std::string::npos) dot = path.size();
+            auto name = std::to_string(frame);
+            name.insert(0, 3 - std::min<size_t>(3, name.size()), '0');
+            save_image(film, path.substr(0, dot) + "_" + name +
+                                 path.substr(dot));
+        }
+    }
+
+    std::clog << "animation: " << options.frames << " frames, bvh "
+              << options.bvh_update << ", " << rebuilds
+              << " rebuilds, update " << update_seconds << " s, render "
+              << render_seconds << " s, mean sah "
+              << sah_sum / options.frames << '\n';
+}
+
+void print_usage() {
+    std::clog
+        << "usage: cray [scene] [options]\n"
+           "scenes: book1 earth noise quads simple_light cornell_box\n"
+           "        cornell_smoke book2 instances animation motion_blur sky\n"
+           "  --output PATH             .png/.pfm/.exr\n"
+           "  --width N --spp N --depth N\n"
+           "  --sampler independent|stratified|sobol|bluenoise\n"
+           "  --seed N --threads N --ray-diff 0|1\n"
+           "  --texture-cache MB        load texture tiles on demand\n"
+           "  --bake-spacing D          bake noise textures into grids\n"
+           "  --tex-format F            image storage rgb8|srgb8|half|bc1\n"
+           "  --lazy-textures 0|1       decode images on first lookup\n"
+           "  --env PATH --env-scale S  equirectangular environment light\n"
+           "  --env-mis 0|1             sample the environment directly\n"
+           "  --checkpoint PATH --checkpoint-interval SECONDS\n"
+           "  --time-budget SECONDS --preview PATH\n"
+           "  --frames N --bvh-update refit|refit-only|rebuild\n"
+           "  --motion-bvh 0|1\n"
+           "  --worker PORT             serve render tasks over TCP\n"
+           "  --workers HOST:PORT,...   coordinator with remote workers\n"
+           "  --local-workers N         coordinator with forked workers\n"
+           "  --tile N --task-spp N --retries N --task-timeout SECONDS\n";
+}
+
+bool parse_options(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            options.scene = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+
+        if (arg == "--output") options.output = value;
+        else if (arg == "--width") options.width = atoi(value);
+        else if (arg == "--spp") options.spp = atoi(value);
+        else if (arg == "--depth") options.depth = atoi(value);
+        else if (arg == "--sampler") {
+            if (!parse_sampler_type(value, options.sampler)) return false;
+        } else if (arg == "--seed") options.seed = atoi(value);
+        else if (arg == "--threads") options.threads = atoi(value);
+        else if (arg == "--checkpoint") options.checkpoint = value;
+        else if (arg == "--checkpoint-interval")
+            options.checkpoint_interval = atof(value);
+        else if (arg == "--time-budget") options.time_budget = atof(value);
+        else if (arg == "--preview") options.preview = value;
+        else if (arg == "--frames") options.frames = atoi(value);
+        else if (arg == "--motion-bvh") options.motion_bvh = atoi(value) != 0;
+        else if (arg == "--ray-diff")
+            options.ray_differentials = atoi(value) != 0;
+        else if (arg == "--texture-cache")
+            options.texture_cache_mb = atof(value);
+        else if (arg == "--bake-spacing")
+            options.bake_spacing = atof(value);
+        else if (arg == "--env") options.env = value;
+        else if (arg == "--env-scale") options.env_scale = atof(value);
+        else if (arg == "--env-mis") options.env_mis = atoi(value) != 0;
+        else if (arg == "--lazy-textures")
+            options.lazy_textures = atoi(value) != 0;
+        else if (arg == "--tex-format") {
+            if (!parse_tex_format(value, options.tex_format)) return false;
+        } else if (arg == "--bvh-update") options.bvh_update = value;
+        else if (arg == "--worker") options.worker_port = atoi(value);
+        else if (arg == "--local-workers")
+            options.dist.local_workers = atoi(value);
+        else if (arg == "--tile") options.dist.tile_size = atoi(value);
+        else if (arg == "--task-spp")
+            options.dist.samples_per_task = atoi(value);
+        else if (arg == "--retries") options.dist.max_retries = atoi(value);
+        else if (arg == "--task-timeout")
+            options.dist.task_timeout = atof(value);
+        else if (arg == "--workers") {
+            std::string list = value;
+            size_t start = 0;
+            while (start < list.size()) {
+                auto end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                if (end > start)
+                    options.dist.workers.push_back(
+                        list.substr(start, end - start));
+                start = end + 1;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const std::map<std::string, std::function<void()>> scenes = {
+        {"book1", [] { render_book1_world(1200, 500, 50); }},
+        {"earth", render_earth},
+        {"noise", render_noise},
+        {"quads", render_quads},
+        {"simple_light", render_simple_light},
+        {"cornell_box", render_cornell_box},
+        {"cornell_smoke", render_cornell_smoke},
+        {"book2", [] { render_book2_scene(400, 250, 4); }},
+        {"instances", render_instances},
+        {"animation", render_animation},
+        {"motion_blur", render_motion_blur},
+        {"sky", render_sky},
+    };
+
+    if (argc == 4 && strcmp(argv[1], "compare") == 0)
+        return compare_images(argv[2], argv[3]);
+    if (argc >= 4 && strcmp(argv[1], "convert") == 0) {
+        TexFormat format = TexFormat::Auto;
+        if (argc == 6 && strcmp(argv[4], "--format") == 0 &&
+            parse_tex_format(argv[5], format))
+            return convert_texture(argv[2], argv[3], format);
+        if (argc == 4) return convert_texture(argv[2], argv[3], format);
+    }
+
+    if (!parse_options(argc, argv) || scenes.count(options.scene) == 0) {
+        print_usage();
+        return 1;
+    }
+
+    // 场景中的纹理在构造时决定是否使用缓存
+    texture_cache().set_budget(
+        static_cast<size_t>(options.texture_cache_mb * (1 << 20)));
+    image_registry().set_lazy(options.lazy_textures);
+    scenes.at(options.scene)();
+}
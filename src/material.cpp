@@ -2,50 +2,120 @@
 
 namespace cray {
 
+// 有像素足迹时滤波查询纹理
+static Color texture_value(const CompiledTex& tex, const HitRecord& rec) {
+    if (!rec.has_differentials) return tex.value(rec.u, rec.v, rec.p);
+    return tex.filtered_value(
+        rec.u, rec.v, rec.p,
+        TexFootprint{rec.dudx, rec.dvdx, rec.dudy, rec.dvdy});
+}
+
+// 镜面反射/折射时传递光线微分 (Igehy 1999)。wo为指向观察者的单位向量，
+// 法线随像素的变化dndx、dndy由表面偏导求出
+struct SpecularDifferentials {
+    SpecularDifferentials(const Ray& r_in, const HitRecord& rec)
+        : n(rec.normal),
+          wo(-unit_vector(r_in.dir)) {
+        auto sign = rec.is_front_face ? 1 : -1;
+        dndx = sign * (rec.dudx * rec.dndu + rec.dvdx * rec.dndv);
+        dndy = sign * (rec.dudy * rec.dndu + rec.dvdy * rec.dndv);
+        dwodx = -unit_vector(r_in.rx_dir) - wo;
+        dwody = -unit_vector(r_in.ry_dir) - wo;
+        dcosdx = dot(dwodx, n) + dot(wo, dndx);
+        dcosdy = dot(dwody, n) + dot(wo, dndy);
+    }
+
+    // wi = -wo + 2(wo·n)n
+    void reflect(const HitRecord& rec, Ray& scattered) const {
+        auto wi = unit_vector(scattered.dir);
+        auto cos = dot(wo, n);
+        set(rec, scattered, wi - dwodx + 2 * (cos * dndx + dcosdx * n),
+            wi - dwody + 2 * (cos * dndy + dcosdy * n));
+    }
+
+    // wi = -eta*wo + mu*n，mu = eta*(wo·n) - cos_t
+    void refract(const HitRecord& rec, Real eta, Ray& scattered) const {
+        auto wi = unit_vector(scattered.dir);
+        auto cos_i = dot(wo, n);
+        auto cos_t = std::fabs(dot(wi, n));
+        auto mu = eta * cos_i - cos_t;
+        auto dmu = eta - eta * eta * cos_i / cos_t;
+        set(rec, scattered, wi - eta * dwodx + mu * dndx + dmu * dcosdx * n,
+            wi - eta * dwody + mu * dndy + dmu * dcosdy * n);
+    }
+
+    void set(const HitRecord& rec, Ray& scattered, const Vec3& rx_dir,
+             const Vec3& ry_dir) const {
+        scattered.has_differentials = true;
+        scattered.rx_origin = rec.p + rec.dpdx;
+        scattered.ry_origin = rec.p + rec.dpdy;
+        scattered.rx_dir = rx_dir;
+        scattered.ry_dir = ry_dir;
+    }
+
+    Vec3 n, wo;
+    Vec3 dndx, dndy;
+    Vec3 dwodx, dwody;
+    Real dcosdx, dcosdy;
+};
+
 bool Lambertian::scatter(const Ray& r_in, const HitRecord& rec,
-                         Color& attenuation, Ray& scattered) const {
-    auto scatter_direction = rec.normal + random_unit_vector();
+                         Sampler& sampler, Color& attenuation,
+                         Ray& scattered) const {
+    auto scatter_direction = rec.normal + sample_unit_vector(sampler.get_2d());
     if (scatter_direction.near_zero()) {
         scatter_direction = rec.normal;
     }
     scattered = Ray(rec.p, scatter_direction, r_in.tm);
-    attenuation = albedo->value(rec.u, rec.v, rec.p);
+    attenuation = texture_value(albedo, rec);
     return true;
 }
 
-bool Metal::scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                    Ray& scattered) const {
+bool Metal::scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                    Color& attenuation, Ray& scattered) const {
     auto scatter_dir = reflect(unit_vector(r_in.dir), rec.normal);
-    scattered = Ray(rec.p, scatter_dir + fuzz * random_unit_vector(), r_in.tm);
+    auto fuzz_dir = fuzz * sample_unit_vector(sampler.get_2d());
+    scattered = Ray(rec.p, scatter_dir + fuzz_dir, r_in.tm);
+    if (rec.has_differentials)
+        SpecularDifferentials(r_in, rec).reflect(rec, scattered);
 
     attenuation = albedo;
     return dot(scattered.dir, rec.normal) > 0;
 }
 
 // 根据视角（入射光）计算反射比，即菲涅尔现象
-double reflectance(double cosine, double ref_idx) {
+Real reflectance(Real cosine, Real ref_idx) {
     // Use Schlick's approximation for reflectance.
     auto r0 = (1 - ref_idx) / (1 + ref_idx);
     r0 = r0 * r0;
-    return r0 + (1 - r0) * pow((1 - cosine), 5);
+    return r0 + (1 - r0) * std::pow(1 - cosine, Real(5));
 }
 
 bool Dielectric::scatter(const Ray& r_in, const HitRecord& rec,
-                         Color& attenuation, Ray& scattered) const {
+                         Sampler& sampler, Color& attenuation,
+                         Ray& scattered) const {
     attenuation = Color(1, 1, 1);
-    double refract_ratio = rec.is_front_face ? (1.0 / ir) : ir;
+    Real refract_ratio = rec.is_front_face ? (1.0 / ir) : ir;
     auto r_in_dir_uint = unit_vector(r_in.dir);
 
-    auto cos_theta = fmin(dot(-r_in_dir_uint, rec.normal), 1.0);
-    auto sin_theta = sqrt(1 - cos_theta * cos_theta);
+    auto cos_theta = std::fmin(dot(-r_in_dir_uint, rec.normal), Real(1));
+    auto sin_theta = std::sqrt(1 - cos_theta * cos_theta);
 
     bool can_refract = refract_ratio * sin_theta <= 1.0;
-    Vec3 scatter_dir;
-    if (can_refract && reflectance(cos_theta, refract_ratio) < random_double())
-        scatter_dir = refract(r_in_dir_uint, rec.normal, refract_ratio);
-    else
-        scatter_dir = reflect(r_in_dir_uint, rec.normal);
+    bool refracted =
+        can_refract && reflectance(cos_theta, refract_ratio) < sampler.get_1d();
+    Vec3 scatter_dir =
+        refracted ? refract(r_in_dir_uint, rec.normal, refract_ratio)
+                  : reflect(r_in_dir_uint, rec.normal);
     scattered = Ray(rec.p, scatter_dir, r_in.tm);
+
+    if (rec.has_differentials) {
+        SpecularDifferentials diff(r_in, rec);
+        if (refracted)
+            diff.refract(rec, refract_ratio, scattered);
+        else
+            diff.reflect(rec, scattered);
+    }
     return true;
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hit_record.h"
+#include "sampler.h"
 #include "texture.h"
 
 namespace cray {
@@ -8,73 +9,93 @@ namespace cray {
 struct Material {
     virtual ~Material() = default;
 
+    // 散射方向所需的随机数从sampler当前顶点的维度中获取
     virtual bool scatter(const Ray& r_in, const HitRecord& rec,
-                         Color& attenuation, Ray& scattered) const = 0;
+                         Sampler& sampler, Color& attenuation,
+                         Ray& scattered) const = 0;
 
-    virtual Color emitted(double u, double v, const Point3& p) const {
+    virtual Color emitted(Real u, Real v, const Point3& p) const {
         return Color(0, 0, 0);
     }
+
+    // scatter采样到单位方向wi的立体角概率密度，用于光源采样的多重重要性采样。
+    // 返回非0的材质其attenuation与方向无关，attenuation*pdf即为f*cosθ。
+    // 镜面、折射等只能由scatter得到方向的材质返回0
+    virtual Real scattering_pdf(const Ray& r_in, const HitRecord& rec,
+                                const Vec3& wi) const {
+        return 0;
+    }
 };
 
 struct Lambertian : public Material {
-    Lambertian(const Color& c) : albedo(std::make_shared<SolidColorTex>(c)) {}
-    Lambertian(std::shared_ptr<Texture> tex) : albedo(tex) {}
-
-    bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                 Ray& scattered) const override;
+    Lambertian(const Color& c) : albedo(c) {}
+    Lambertian(std::shared_ptr<Texture> tex) : albedo(std::move(tex)) {}
+
+    bool scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                 Color& attenuation, Ray& scattered) const override;
+    // 余弦分布 cosθ/π
+    Real scattering_pdf(const Ray& r_in, const HitRecord& rec,
+                        const Vec3& wi) const override {
+        auto cos_theta = dot(rec.normal, wi);
+        return cos_theta > 0 ? cos_theta / PI : 0;
+    }
 
-    std::shared_ptr<Texture> albedo;
+    CompiledTex albedo;
 };
 
 struct Metal : public Material {
-    Metal(const Color& c, double f) : albedo(c), fuzz(f) {}
+    Metal(const Color& c, Real f) : albedo(c), fuzz(f) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                 Ray& scattered) const override;
+    bool scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                 Color& attenuation, Ray& scattered) const override;
 
     Color albedo;
-    double fuzz;  // 粗糙程度
+    Real fuzz;  // 粗糙程度
 };
 
 // 电介质，绝缘体
 struct Dielectric : public Material {
-    Dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+    Dielectric(Real index_of_refraction) : ir(index_of_refraction) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                 Ray& scattered) const override;
+    bool scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                 Color& attenuation, Ray& scattered) const override;
 
-    double ir;
+    Real ir;
 };
 
 struct DiffuseLight : public Material {
-    DiffuseLight(std::shared_ptr<Texture> a) : emit(a) {}
-    DiffuseLight(Color c) : emit(std::make_shared<SolidColorTex>(c)) {}
+    DiffuseLight(std::shared_ptr<Texture> a) : emit(std::move(a)) {}
+    DiffuseLight(Color c) : emit(c) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                 Ray& scattered) const override {
+    bool scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                 Color& attenuation, Ray& scattered) const override {
         return false;
     }
 
-    Color emitted(double u, double v, const Point3& p) const override {
-        return emit->value(u, v, p);
+    Color emitted(Real u, Real v, const Point3& p) const override {
+        return emit.value(u, v, p);
     }
 
-    std::shared_ptr<Texture> emit;
+    CompiledTex emit;
 };
 
 // 各向同性
 struct Isotropic : public Material {
-    Isotropic(Color c) : albedo(std::make_shared<SolidColorTex>(c)) {}
-    Isotropic(std::shared_ptr<Texture> tex) : albedo(tex) {}
+    Isotropic(Color c) : albedo(c) {}
+    Isotropic(std::shared_ptr<Texture> tex) : albedo(std::move(tex)) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, Color& attenuation,
-                 Ray& scattered) const override {
-        scattered = Ray(rec.p, random_unit_vector(), r_in.tm);
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+    bool scatter(const Ray& r_in, const HitRecord& rec, Sampler& sampler,
+                 Color& attenuation, Ray& scattered) const override {
+        scattered = Ray(rec.p, sample_unit_vector(sampler.get_2d()), r_in.tm);
+        attenuation = albedo.value(rec.u, rec.v, rec.p);
         return true;
     }
+    Real scattering_pdf(const Ray& r_in, const HitRecord& rec,
+                        const Vec3& wi) const override {
+        return 1 / (4 * PI);
+    }
 
-    std::shared_ptr<Texture> albedo;
+    CompiledTex albedo;
 };
 
 }  // namespace cray
\ No newline at end of file
@@ -0,0 +1,738 @@
+#include "mipmap.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "texture_cache.h"
+
+namespace cray {
+
+// tile内坐标(0~31)的位扩展表，Morton序号为 x的扩展 | y的扩展<<1
+struct MortonTable {
+    MortonTable() {
+        for (uint32_t v = 0; v < MipMap::TileSize; ++v) {
+            uint32_t bits = 0;
+            for (int b = 0; b < MipMap::TileShift; ++b)
+                bits |= ((v >> b) & 1) << (2 * b);
+            spread[v] = bits;
+        }
+    }
+    uint16_t spread[MipMap::TileSize];
+};
+
+static const MortonTable morton_table;
+
+static uint32_t morton(uint32_t x, uint32_t y) {
+    return morton_table.spread[x] | morton_table.spread[y] << 1;
+}
+
+// sRGB编码的8位值到线性值
+struct SrgbTable {
+    SrgbTable() {
+        for (int i = 0; i < 256; ++i) {
+            Real c = i / Real(255);
+            linear[i] = c <= 0.04045 ? c / 12.92
+                                     : std::pow((c + 0.055) / 1.055, 2.4);
+        }
+    }
+    Real linear[256];
+};
+
+static const SrgbTable srgb_table;
+
+static unsigned char encode_srgb(Real linear) {
+    auto c = linear <= 0.0031308
+                 ? 12.92 * linear
+                 : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+    return static_cast<unsigned char>(
+        std::clamp(static_cast<int>(c * 255 + 0.5), 0, 255));
+}
+
+bool parse_tex_format(const std::string& name, TexFormat& format) {
+    static const std::pair<const char*, TexFormat> names[] = {
+        {"auto", TexFormat::Auto}, {"rgb8", TexFormat::RGB8},
+        {"srgb8", TexFormat::SRGB8}, {"half", TexFormat::Half},
+        {"bc1", TexFormat::BC1}};
+    for (const auto& [n, f] : names) {
+        if (name == n) {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* tex_format_name(TexFormat format) {
+    switch (format) {
+        case TexFormat::RGB8: return "rgb8";
+        case TexFormat::SRGB8: return "srgb8";
+        case TexFormat::Half: return "half";
+        case TexFormat::BC1: return "bc1";
+        default: return "auto";
+    }
+}
+
+int MipMap::tile_bytes(TexFormat format) {
+    switch (format) {
+        case TexFormat::Half: return 6 * TileTexels;
+        case TexFormat::BC1: return TileTexels / 2;
+        default: return 3 * TileTexels;
+    }
+}
+
+// IEEE半精度浮点，舍入到最近偶数，超出范围时为无穷
+static uint16_t float_to_half(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+    if (bits >= 0x7f800000)  // inf/nan
+        return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+    if (bits >= 0x477ff000) return sign | 0x7c00;  // 舍入后>=65520
+    if (bits < 0x38800000) {
+        // 小于2^-14时为非规格化数，尾数为f*2^24
+        float a;
+        std::memcpy(&a, &bits, 4);
+        return sign | static_cast<uint16_t>(std::lrint(a * 16777216.0f));
+    }
+    // 指数减去112，低13位按最近偶数舍入
+    bits += 0xc8000fff + ((bits >> 13) & 1);
+    return sign | static_cast<uint16_t>(bits >> 13);
+}
+
+static float half_to_float(uint16_t h) {
+    uint32_t bits = (h & 0x7fffu) << 13;
+    if ((h & 0x7c00) == 0x7c00) bits |= 0x7f800000;
+    float f;
+    std::memcpy(&f, &bits, 4);
+    f *= 0x1p112f;
+    return (h & 0x8000) ? -f : f;
+}
+
+// BC1端点为RGB565，展开到8位
+static void unpack_565(uint16_t c, int rgb[3]) {
+    int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static uint16_t pack_565(const int rgb[3]) {
+    auto q = [](int v, int bits) {
+        int max = (1 << bits) - 1;
+        return (v * max + 127) / 255;
+    };
+    return static_cast<uint16_t>(q(rgb[0], 5) << 11 | q(rgb[1], 6) << 5 |
+                                 q(rgb[2], 5));
+}
+
+// 调色板下标0、1为端点，c0 > c1时2、3为1/3、2/3处的插值，
+// 否则2为中点、3为黑色
+static void bc1_palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (c0 > c1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// 压缩一个4x4块。端点取包围盒的4条对角线之一，选误差最小的
+static void encode_bc1(const unsigned char texels[16][3], unsigned char* out) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min<int>(lo[c], texels[i][c]);
+            hi[c] = std::max<int>(hi[c], texels[i][c]);
+        }
+    }
+
+    long best_error = -1;
+    uint16_t best_c0 = 0, best_c1 = 0;
+    uint32_t best_indices = 0;
+    for (int diagonal = 0; diagonal < 4; ++diagonal) {
+        // 红色通道从lo到hi，绿、蓝按diagonal的两位决定方向
+        int a[3] = {hi[0], hi[1], hi[2]}, b[3] = {lo[0], lo[1], lo[2]};
+        if (diagonal & 1) std::swap(a[1], b[1]);
+        if (diagonal & 2) std::swap(a[2], b[2]);
+        uint16_t c0 = pack_565(a), c1 = pack_565(b);
+        if (c0 < c1) std::swap(c0, c1);
+
+        int palette[4][3];
+        bc1_palette(c0, c1, palette);
+        // 两端点相同时只用下标0，避免进入三色模式的黑色
+        int choices = c0 == c1 ? 1 : 4;
+        long error = 0;
+        uint32_t indices = 0;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            long best_d = -1;
+            for (int k = 0; k < choices; ++k) {
+                long d = 0;
+                for (int c = 0; c < 3; ++c) {
+                    long e = texels[i][c] - palette[k][c];
+                    d += e * e;
+                }
+                if (best_d < 0 || d < best_d) {
+                    best_d = d;
+                    best = k;
+                }
+            }
+            error += best_d;
+            indices |= uint32_t(best) << (2 * i);
+        }
+        if (best_error < 0 || error < best_error) {
+            best_error = error;
+            best_c0 = c0;
+            best_c1 = c1;
+            best_indices = indices;
+        }
+    }
+    std::memcpy(out, &best_c0, 2);
+    std::memcpy(out + 2, &best_c1, 2);
+    std::memcpy(out + 4, &best_indices, 4);
+}
+
+// 逐行存放的一级数据按格式编码成tile。8位格式用rows，Half用hdr_rows
+static std::vector<unsigned char> encode_tiles(
+    TexFormat format, const std::vector<unsigned char>& rows,
+    const std::vector<float>& hdr_rows, int width, int height, int tiles_x,
+    int tiles_y) {
+    const int tile_bytes = MipMap::tile_bytes(format);
+    const int mask = MipMap::TileSize - 1;
+    std::vector<unsigned char> tiles(
+        static_cast<size_t>(tiles_x) * tiles_y * tile_bytes, 0);
+    auto tile_of = [&](int x, int y) {
+        return static_cast<size_t>(y >> MipMap::TileShift) * tiles_x +
+               (x >> MipMap::TileShift);
+    };
+
+    if (format == TexFormat::BC1) {
+        // tile内的4x4块也按Morton顺序排列，超出图像的纹素取边缘值
+        for (int by = 0; by < (height + 3) / 4; ++by) {
+            for (int bx = 0; bx < (width + 3) / 4; ++bx) {
+                unsigned char texels[16][3];
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(4 * bx + (i & 3), width - 1);
+                    int y = std::min(4 * by + (i >> 2), height - 1);
+                    auto src = 3 * (static_cast<size_t>(y) * width + x);
+                    for (int c = 0; c < 3; ++c) texels[i][c] = rows[src + c];
+                }
+                auto dst = tile_of(4 * bx, 4 * by) * tile_bytes +
+                           8 * morton((4 * bx & mask) >> 2,
+                                      (4 * by & mask) >> 2);
+                encode_bc1(texels, tiles.data() + dst);
+            }
+        }
+        return tiles;
+    }
+
+    int texel_bytes = tile_bytes / MipMap::TileTexels;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            auto dst = tile_of(x, y) * tile_bytes +
+                       texel_bytes * morton(x & mask, y & mask);
+            auto src = 3 * (static_cast<size_t>(y) * width + x);
+            if (format == TexFormat::Half) {
+                uint16_t half[3];
+                for (int c = 0; c < 3; ++c)
+                    half[c] = float_to_half(hdr_rows[src + c]);
+                std::memcpy(tiles.data() + dst, half, sizeof(half));
+            } else {
+                for (int c = 0; c < 3; ++c) tiles[dst + c] = rows[src + c];
+            }
+        }
+    }
+    return tiles;
+}
+
+// 宽高减半，奇数边长时最后一行/列重复使用。average求4个值的平均
+template <typename T, typename Average>
+static std::vector<T> downsample(const std::vector<T>& rows, int width,
+                                 int height, int w, int h, Average average) {
+    std::vector<T> next(3 * static_cast<size_t>(w) * h);
+    auto at = [&](int x, int y, int c) {
+        return rows[3 * (static_cast<size_t>(y) * width + x) + c];
+    };
+    for (int y = 0; y < h; ++y) {
+        int y0 = std::min(2 * y, height - 1);
+        int y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < w; ++x) {
+            int x0 = std::min(2 * x, width - 1);
+            int x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 3; ++c) {
+                next[3 * (static_cast<size_t>(y) * w + x) + c] =
+                    average(at(x0, y0, c), at(x1, y0, c), at(x0, y1, c),
+                            at(x1, y1, c));
+            }
+        }
+    }
+    return next;
+}
+
+MipMap::MipMap(const CRayImage& image, TexFormat format) {
+    if (image.invalid()) return;
+    if (format == TexFormat::Auto)
+        format = image.hdr() ? TexFormat::Half : TexFormat::RGB8;
+    format_ = format;
+    tile_bytes_ = tile_bytes(format);
+
+    // 8位格式和Half分别在rows和hdr_rows上生成各级，
+    // 输入与格式不符时先转换：HDR截断到[0,1]，8位值除以255
+    int width = image.width(), height = image.height();
+    size_t count = 3 * static_cast<size_t>(width) * height;
+    std::vector<unsigned char> rows;
+    std::vector<float> hdr_rows;
+    if (format == TexFormat::Half) {
+        hdr_rows.resize(count);
+        for (int y = 0; y < height; ++y) {
+            auto dst = hdr_rows.data() + 3 * static_cast<size_t>(y) * width;
+            if (image.hdr()) {
+                std::memcpy(dst, image.hdr_pixel_data(0, y),
+                            3 * width * sizeof(float));
+                continue;
+            }
+            auto src = image.pixel_data(0, y);
+            for (int x = 0; x < 3 * width; ++x) dst[x] = src[x] / 255.0f;
+        }
+    } else {
+        rows.resize(count);
+        for (int y = 0; y < height; ++y) {
+            auto dst = rows.data() + 3 * static_cast<size_t>(y) * width;
+            if (!image.hdr()) {
+                std::memcpy(dst, image.pixel_data(0, y), 3 * width);
+                continue;
+            }
+            auto src = image.hdr_pixel_data(0, y);
+            for (int x = 0; x < 3 * width; ++x) {
+                Real v = std::clamp<Real>(src[x], 0, 1);
+                dst[x] = format == TexFormat::SRGB8
+                             ? encode_srgb(v)
+                             : static_cast<unsigned char>(v * 255 + 0.5);
+            }
+        }
+    }
+
+    if (texture_cache().enabled()) {
+        file_ = std::tmpfile();
+        cache_id_ = texture_cache().new_texture_id();
+    }
+
+    while (true) {
+        Level level{width, height, (width + TileSize - 1) / TileSize,
+                    (height + TileSize - 1) / TileSize};
+        auto tiles = encode_tiles(format, rows, hdr_rows, width, height,
+                                  level.tiles_x, level.tiles_y);
+        // 各级先留在内存中，临时文件完整写入后再释放。
+        // 写入失败时关闭文件，退回常驻内存
+        if (file_) {
+            level.file_offset = std::ftell(file_);
+            if (std::fwrite(tiles.data(), 1, tiles.size(), file_) !=
+                tiles.size()) {
+                std::fclose(file_);
+                file_ = nullptr;
+            }
+        }
+        level.data = std::move(tiles);
+        levels_.push_back(std::move(level));
+        if (width == 1 && height == 1) break;
+
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        if (format == TexFormat::Half) {
+            hdr_rows = downsample(hdr_rows, width, height, w, h,
+                                  [](float a, float b, float c, float d) {
+                                      return (a + b + c + d) * 0.25f;
+                                  });
+        } else if (format == TexFormat::SRGB8) {
+            const auto& lin = srgb_table.linear;
+            rows = downsample(rows, width, height, w, h,
+                              [&](int a, int b, int c, int d) {
+                                  return encode_srgb(
+                                      (lin[a] + lin[b] + lin[c] + lin[d]) / 4);
+                              });
+        } else {
+            rows = downsample(rows, width, height, w, h,
+                              [](int a, int b, int c, int d) {
+                                  return static_cast<unsigned char>(
+                                      (a + b + c + d + 2) / 4);
+                              });
+        }
+        width = w;
+        height = h;
+    }
+    if (file_ && std::fflush(file_) != 0) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    for (auto& l : levels_) {
+        if (file_) std::vector<unsigned char>().swap(l.data);
+        l.tiles = l.data.data();
+    }
+}
+
+MipMap::~MipMap() {
+    if (file_) std::fclose(file_);
+    if (map_) munmap(map_, map_size_);
+}
+
+// 纹理容器(.ctex)按本机字节序存放：文件头，每级一个ContainerLevel，
+// 之后是各级的tile数据，布局与内存中相同，起始位置按64字节对齐
+struct ContainerHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t tile_shift;
+    uint32_t levels;
+    uint32_t format;  // TexFormat，版本1没有此字段，由flags决定
+};
+
+struct ContainerLevel {
+    uint32_t width, height;
+    uint64_t offset;
+};
+
+static const char ContainerMagic[4] = {'C', 'T', 'E', 'X'};
+static const uint32_t ContainerVersion = 2;
+static const uint32_t ContainerSrgb = 1;
+// 每级宽高的上限，保证换算成int和tile数时不溢出
+static const uint32_t MaxContainerSize = 1u << 24;
+
+static uint64_t container_align(uint64_t offset) {
+    return (offset + 63) & ~uint64_t(63);
+}
+
+bool MipMap::save(const std::string& path) const {
+    if (empty()) return false;
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    ContainerHeader header{};
+    std::memcpy(header.magic, ContainerMagic, 4);
+    header.version = ContainerVersion;
+    header.flags = format_ == TexFormat::SRGB8 ? ContainerSrgb : 0;
+    header.format = static_cast<uint32_t>(format_);
+    header.tile_shift = TileShift;
+    header.levels = static_cast<uint32_t>(levels_.size());
+
+    std::vector<ContainerLevel> infos;
+    uint64_t offset = container_align(sizeof(header) +
+                                      levels_.size() * sizeof(ContainerLevel));
+    for (const auto& l : levels_) {
+        infos.push_back(ContainerLevel{static_cast<uint32_t>(l.width),
+                                       static_cast<uint32_t>(l.height),
+                                       offset});
+        offset = container_align(offset + static_cast<uint64_t>(l.tiles_x) *
+                                              l.tiles_y * tile_bytes_);
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(infos.data()),
+              infos.size() * sizeof(ContainerLevel));
+    for (int i = 0; i < levels(); ++i) {
+        const auto& l = levels_[i];
+        out.seekp(static_cast<std::streamoff>(infos[i].offset));
+        for (uint32_t tile = 0; tile < uint32_t(l.tiles_x * l.tiles_y); ++tile)
+            out.write(reinterpret_cast<const char*>(tile_data(i, tile)),
+                      tile_bytes_);
+    }
+    return static_cast<bool>(out);
+}
+
+std::shared_ptr<MipMap> MipMap::map(const std::string& path) {
+    auto mip = std::make_shared<MipMap>();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return mip;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(ContainerHeader))) {
+        close(fd);
+        return mip;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return mip;
+    mip->map_ = addr;
+    mip->map_size_ = size;
+
+    auto base = static_cast<const unsigned char*>(addr);
+    ContainerHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, ContainerMagic, 4) != 0 ||
+        header.version < 1 || header.version > ContainerVersion ||
+        header.tile_shift != TileShift || header.levels == 0 ||
+        size < sizeof(header) + header.levels * sizeof(ContainerLevel))
+        return mip;
+
+    if (header.version == 1)
+        header.format = static_cast<uint32_t>(
+            header.flags & ContainerSrgb ? TexFormat::SRGB8 : TexFormat::RGB8);
+    if (header.format < static_cast<uint32_t>(TexFormat::RGB8) ||
+        header.format > static_cast<uint32_t>(TexFormat::BC1))
+        return mip;
+    mip->format_ = static_cast<TexFormat>(header.format);
+    mip->tile_bytes_ = tile_bytes(mip->format_);
+    for (uint32_t i = 0; i < header.levels; ++i) {
+        ContainerLevel info;
+        std::memcpy(&info, base + sizeof(header) + i * sizeof(info),
+                    sizeof(info));
+        // 第0级之后每级都是上一级的一半，与构造时的层级链一致
+        const auto* prev = i > 0 ? &mip->levels_.back() : nullptr;
+        if (info.width > MaxContainerSize || info.height > MaxContainerSize ||
+            (prev && (int(info.width) != std::max(1, prev->width / 2) ||
+                      int(info.height) != std::max(1, prev->height / 2)))) {
+            mip->levels_.clear();
+            return mip;
+        }
+        Level level{int(info.width), int(info.height),
+                    int((info.width + TileSize - 1) / TileSize),
+                    int((info.height + TileSize - 1) / TileSize)};
+        auto bytes = uint64_t(level.tiles_x) * level.tiles_y * mip->tile_bytes_;
+        if (info.width == 0 || info.height == 0 || info.offset > size ||
+            bytes > size - info.offset) {
+            mip->levels_.clear();
+            return mip;
+        }
+        level.tiles = base + info.offset;
+        mip->levels_.push_back(std::move(level));
+    }
+    return mip;
+}
+
+Color MipMap::decode(const unsigned char* tile, int x, int y) const {
+    switch (format_) {
+        case TexFormat::SRGB8: {
+            auto p = tile + 3 * morton(x, y);
+            const auto& lin = srgb_table.linear;
+            return Color(lin[p[0]], lin[p[1]], lin[p[2]]);
+        }
+        case TexFormat::Half: {
+            uint16_t h[3];
+            std::memcpy(h, tile + 6 * morton(x, y), sizeof(h));
+            return Color(half_to_float(h[0]), half_to_float(h[1]),
+                         half_to_float(h[2]));
+        }
+        case TexFormat::BC1: {
+            auto block = tile + 8 * morton(x >> 2, y >> 2);
+            uint16_t c0, c1;
+            uint32_t indices;
+            std::memcpy(&c0, block, 2);
+            std::memcpy(&c1, block + 2, 2);
+            std::memcpy(&indices, block + 4, 4);
+            int palette[4][3];
+            bc1_palette(c0, c1, palette);
+            auto p = palette[(indices >> (2 * ((y & 3) * 4 + (x & 3)))) & 3];
+            const Real color_scale = 1.0 / 255.0;
+            return Color(color_scale * p[0], color_scale * p[1],
+                         color_scale * p[2]);
+        }
+        default: {
+            auto p = tile + 3 * morton(x, y);
+            const Real color_scale = 1.0 / 255.0;
+            return Color(color_scale * p[0], color_scale * p[1],
+                         color_scale * p[2]);
+        }
+    }
+}
+
+Color MipMap::texel(int level, int x, int y) const {
+    const auto& l = levels_[level];
+    x = clamp(x, 0, l.width);
+    y = clamp(y, 0, l.height);
+    uint32_t tile = (y >> TileShift) * l.tiles_x + (x >> TileShift);
+    return decode(tile_data(level, tile), x & (TileSize - 1),
+                  y & (TileSize - 1));
+}
+
+const unsigned char* MipMap::tile_data(int level, uint32_t tile) const {
+    if (file_) return cached_tile(level, tile);
+    return levels_[level].tiles + size_t(tile) * tile_bytes_;
+}
+
+const unsigned char* MipMap::cached_tile(int level, uint32_t tile) const {
+    // 每个线程记住最近一次用到的tile，连续的查询大多落在同一个tile上，
+    // 不必每次访问加锁的缓存。返回的指针在该线程下次调用前有效
+    thread_local uint64_t last_key = ~0ull;
+    thread_local std::shared_ptr<const TextureCache::Tile> last_tile;
+
+    auto key = TextureCache::key(cache_id_, level, tile);
+    if (key != last_key) {
+        auto& cache = texture_cache();
+        auto data = cache.find(key);
+        if (!data) {
+            TextureCache::Tile buffer(tile_bytes_);
+            auto offset = levels_[level].file_offset +
+                          static_cast<long>(tile) * tile_bytes_;
+            if (pread(fileno(file_), buffer.data(), tile_bytes_, offset) !=
+                tile_bytes_) {
+                // 读取失败时返回全零的tile，不放入缓存，下次重新读取
+                std::fill(buffer.begin(), buffer.end(), 0);
+                last_tile = std::make_shared<const TextureCache::Tile>(
+                    std::move(buffer));
+                last_key = ~0ull;
+                return last_tile->data();
+            }
+            data = cache.insert(key, std::move(buffer));
+        }
+        last_tile = std::move(data);
+        last_key = key;
+    }
+    return last_tile->data();
+}
+
+Color MipMap::nearest(Real s, Real t) const {
+    return texel(0, static_cast<int>(s * levels_[0].width),
+                 static_cast<int>(t * levels_[0].height));
+}
+
+Color MipMap::bilinear(int level, Real s, Real t) const {
+    // 纹素中心位于(i+0.5)/width
+    auto x = s * levels_[level].width - 0.5;
+    auto y = t * levels_[level].height - 0.5;
+    auto x0 = std::floor(x), y0 = std::floor(y);
+    Real dx = x - x0, dy = y - y0;
+    int ix = static_cast<int>(x0), iy = static_cast<int>(y0);
+
+    // 四个纹素在同一个tile内时只定位一次tile
+    const auto& l = levels_[level];
+    int tx = ix & (TileSize - 1), ty = iy & (TileSize - 1);
+    if (ix >= 0 && iy >= 0 && ix + 1 < l.width && iy + 1 < l.height &&
+        tx != TileSize - 1 && ty != TileSize - 1) {
+        uint32_t tile = (iy >> TileShift) * l.tiles_x + (ix >> TileShift);
+        auto data = tile_data(level, tile);
+        return (1 - dx) * (1 - dy) * decode(data, tx, ty) +
+               dx * (1 - dy) * decode(data, tx + 1, ty) +
+               (1 - dx) * dy * decode(data, tx, ty + 1) +
+               dx * dy * decode(data, tx + 1, ty + 1);
+    }
+
+    return (1 - dx) * (1 - dy) * texel(level, ix, iy) +
+           dx * (1 - dy) * texel(level, ix + 1, iy) +
+           (1 - dx) * dy * texel(level, ix, iy + 1) +
+           dx * dy * texel(level, ix + 1, iy + 1);
+}
+
+Real MipMap::level_of(Real width) const {
+    auto res = std::max(levels_[0].width, levels_[0].height);
+    return std::log2(std::max(width * res, Real(1e-8)));
+}
+
+Color MipMap::trilinear(Real s, Real t, Real width) const {
+    auto level = level_of(width);
+    if (level <= 0) return bilinear(0, s, t);
+    if (level >= levels() - 1) return bilinear(levels() - 1, s, t);
+
+    int i = static_cast<int>(level);
+    Real delta = level - i;
+    return (1 - delta) * bilinear(i, s, t) + delta * bilinear(i + 1, s, t);
+}
+
+Color MipMap::ewa(Real s, Real t, Real ds0, Real dt0, Real ds1,
+                  Real dt1) const {
+    // 保证第一条为长轴
+    if (ds0 * ds0 + dt0 * dt0 < ds1 * ds1 + dt1 * dt1) {
+        std::swap(ds0, ds1);
+        std::swap(dt0, dt1);
+    }
+    auto major = std::sqrt(ds0 * ds0 + dt0 * dt0);
+    auto minor = std::sqrt(ds1 * ds1 + dt1 * dt1);
+
+    if (minor * MaxAnisotropy < major && minor > 0) {
+        auto scale = major / (minor * MaxAnisotropy);
+        ds1 *= scale;
+        dt1 *= scale;
+        minor *= scale;
+    }
+    if (minor == 0) return bilinear(0, s, t);
+
+    // 按短轴选择层级，长轴方向由椭圆覆盖
+    auto level = std::max(Real(0), level_of(minor));
+    int i = static_cast<int>(level);
+    if (i >= levels() - 1) return bilinear(levels() - 1, s, t);
+    Real delta = level - i;
+    auto c0 = ewa_level(i, s, t, ds0, dt0, ds1, dt1);
+    if (delta == 0) return c0;
+    auto c1 = ewa_level(i + 1, s, t, ds0, dt0, ds1, dt1);
+    return (1 - delta) * c0 + delta * c1;
+}
+
+// 高斯权重表，下标为纹素到椭圆中心的归一化距离平方r2乘以表长
+static const int EwaWeightCount = 128;
+
+struct EwaWeights {
+    EwaWeights() {
+        const Real alpha = 2;
+        for (int i = 0; i < EwaWeightCount; ++i) {
+            Real r2 = Real(i) / (EwaWeightCount - 1);
+            w[i] = std::exp(-alpha * r2) - std::exp(-alpha);
+        }
+    }
+    Real w[EwaWeightCount];
+};
+
+static const EwaWeights ewa_weights;
+
+Color MipMap::ewa_level(int level, Real s, Real t, Real ds0, Real dt0,
+                        Real ds1, Real dt1) const {
+    const auto& l = levels_[level];
+
+    // 转到该层的纹素坐标
+    auto x = s * l.width - 0.5;
+    auto y = t * l.height - 0.5;
+    ds0 *= l.width;
+    dt0 *= l.height;
+    ds1 *= l.width;
+    dt1 *= l.height;
+
+    // 椭圆的隐式方程 A*ds^2 + B*ds*dt + C*dt^2 < 1，
+    // 各加1保证椭圆至少覆盖一个纹素
+    auto A = dt0 * dt0 + dt1 * dt1 + 1;
+    auto B = -2 * (ds0 * dt0 + ds1 * dt1);
+    auto C = ds0 * ds0 + ds1 * ds1 + 1;
+    auto inv_f = 1 / (A * C - B * B * 0.25);
+    A *= inv_f;
+    B *= inv_f;
+    C *= inv_f;
+
+    // 椭圆的包围矩形
+    auto det = -B * B + 4 * A * C;
+    auto inv_det = 1 / det;
+    auto s_radius = 2 * inv_det * std::sqrt(det * C);
+    auto t_radius = 2 * inv_det * std::sqrt(det * A);
+    int x0 = static_cast<int>(std::ceil(x - s_radius));
+    int x1 = static_cast<int>(std::floor(x + s_radius));
+    int y0 = static_cast<int>(std::ceil(y - t_radius));
+    int y1 = static_cast<int>(std::floor(y + t_radius));
+
+    Color sum(0, 0, 0);
+    Real weight_sum = 0;
+    for (int iy = y0; iy <= y1; ++iy) {
+        Real dy = iy - y;
+        for (int ix = x0; ix <= x1; ++ix) {
+            Real dx = ix - x;
+            auto r2 = A * dx * dx + B * dx * dy + C * dy * dy;
+            if (r2 >= 1) continue;
+            auto w = ewa_weights.w[std::min(
+                static_cast<int>(r2 * EwaWeightCount), EwaWeightCount - 1)];
+            sum += w * texel(level, ix, iy);
+            weight_sum += w;
+        }
+    }
+    if (!(weight_sum > 0)) return bilinear(level, s, t);
+    return sum / weight_sum;
+}
+
+size_t MipMap::memory_bytes() const {
+    size_t bytes = sizeof(*this) + levels_.capacity() * sizeof(Level);
+    for (const auto& l : levels_) bytes += l.data.capacity();
+    return bytes;
+}
+
+}  // namespace cray
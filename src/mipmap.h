@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cgmath.h"
+#include "cray_image.h"
+
+namespace cray {
+
+// 纹素的存储格式，数值写入纹理容器
+enum class TexFormat : uint32_t {
+    Auto = 0,   // HDR图像用Half，其余用RGB8
+    RGB8 = 1,   // 每通道8位，按线性值查询
+    SRGB8 = 2,  // 每通道8位sRGB编码，查表转为线性值
+    Half = 3,   // 每通道16位浮点，用于HDR
+    BC1 = 4,    // 4x4块压缩，每块两个RGB565端点和2位下标，每纹素0.5字节
+};
+
+// 名称为rgb8/srgb8/half/bc1/auto，无法识别时返回false
+bool parse_tex_format(const std::string& name, TexFormat& format);
+const char* tex_format_name(TexFormat format);
+
+// RGB图像的mip金字塔，加载时逐级2x2平均生成。
+// 查询坐标s,t∈[0,1]，t=0对应图像第一行，越界时clamp到边缘。
+// 每级按32x32的tile存放，tile内按Morton顺序排列，相邻纹素大多在同一个tile中。
+// 启用全局纹理缓存时tile写入临时文件，查询时经缓存按需读取。
+// 也可以直接映射save()写出的纹理容器(.ctex)，tile不经复制即可查询
+class MipMap {
+public:
+    MipMap() {}
+    // SRGB8和Half在线性空间生成下一级，RGB8和BC1直接平均8位值
+    explicit MipMap(const CRayImage& image,
+                    TexFormat format = TexFormat::Auto);
+    ~MipMap();
+
+    MipMap(const MipMap&) = delete;
+    MipMap& operator=(const MipMap&) = delete;
+
+    // 映射纹理容器，文件无效时返回空的MipMap。
+    // 映射的页面由系统页缓存管理，同时渲染的多个进程共享
+    static std::shared_ptr<MipMap> map(const std::string& path);
+    bool save(const std::string& path) const;
+
+    bool empty() const { return levels_.empty(); }
+    TexFormat format() const { return format_; }
+    int levels() const { return static_cast<int>(levels_.size()); }
+    int width(int level) const { return levels_[level].width; }
+    int height(int level) const { return levels_[level].height; }
+
+    // 第0级最近邻，不滤波
+    Color nearest(Real s, Real t) const;
+    Color bilinear(int level, Real s, Real t) const;
+    // 各向同性滤波，width为足迹在纹理坐标中的宽度，在相邻两级间线性插值
+    Color trilinear(Real s, Real t, Real width) const;
+    // 椭圆加权平均，(ds0, dt0)与(ds1, dt1)为足迹椭圆的两条轴
+    Color ewa(Real s, Real t, Real ds0, Real dt0, Real ds1, Real dt1) const;
+
+    // 常驻内存的部分，使用缓存时tile计入缓存，映射的容器计入页缓存
+    size_t memory_bytes() const;
+
+    // EWA时椭圆长短轴之比的上限，超过时放大短轴，限制每次查询的纹素数
+    static constexpr Real MaxAnisotropy = 8;
+
+    static const int TileShift = 5;
+    static const int TileSize = 1 << TileShift;
+    static const int TileTexels = TileSize * TileSize;
+    // 各格式一个tile占用的字节数
+    static int tile_bytes(TexFormat format);
+
+private:
+    struct Level {
+        int width, height;
+        int tiles_x, tiles_y;
+        std::vector<unsigned char> data;       // 常驻时的tile数据
+        const unsigned char* tiles = nullptr;  // 指向data或映射的容器
+        long file_offset = 0;                  // 使用缓存时在临时文件中的位置
+    };
+
+    // 解码tile内(x, y)处的纹素，x, y∈[0, TileSize)
+    Color decode(const unsigned char* tile, int x, int y) const;
+    Color texel(int level, int x, int y) const;
+    const unsigned char* tile_data(int level, uint32_t tile) const;
+    const unsigned char* cached_tile(int level, uint32_t tile) const;
+    // 足迹宽度对应的层级(可为小数)，第0级最清晰
+    Real level_of(Real width) const;
+    Color ewa_level(int level, Real s, Real t, Real ds0, Real dt0, Real ds1,
+                    Real dt1) const;
+
+    std::vector<Level> levels_;
+    FILE* file_ = nullptr;  // 非空时tile经纹理缓存读取
+    uint32_t cache_id_ = 0;
+    void* map_ = nullptr;  // 映射的纹理容器
+    size_t map_size_ = 0;
+    TexFormat format_ = TexFormat::RGB8;
+    int tile_bytes_ = tile_bytes(TexFormat::RGB8);
+};
+
+}  // namespace cray
@@ -0,0 +1,116 @@
+#include "perlin.h"
+#include <algorithm>
+
+namespace cray {
+
+// 噪声表使用独立的随机数key，不占用场景构建时的随机数序列
+static const uint64_t PerlinSeed = 0x5065726c696eull;
+
+Perlin::Tables::Tables() {
+    auto saved = random_stream();
+    seed_random_stream(PerlinSeed);
+
+    for (int i = 0; i < POINT_COUNT; ++i) {
+        auto g = unit_vector(Vec3::random(-1, 1));
+        gradient[i][0] = static_cast<float>(g.x);
+        gradient[i][1] = static_cast<float>(g.y);
+        gradient[i][2] = static_cast<float>(g.z);
+        gradient[i][3] = 0;
+    }
+    for (auto perm : {perm_x, perm_y, perm_z}) {
+        for (int i = 0; i < POINT_COUNT; ++i) perm[i] = static_cast<uint8_t>(i);
+        for (int i = POINT_COUNT - 1; i > 0; --i)
+            std::swap(perm[i], perm[random_int(0, i)]);
+    }
+
+    random_stream() = saved;
+}
+
+const Perlin::Tables& Perlin::tables() {
+    static const Tables t;
+    return t;
+}
+
+Real Perlin::noise(const Point3& p) const {
+    const auto& t = tables();
+
+    int i = floor_int(p.x), j = floor_int(p.y), k = floor_int(p.z);
+    auto u = static_cast<float>(p.x - i);
+    auto v = static_cast<float>(p.y - j);
+    auto w = static_cast<float>(p.z - k);
+
+    // 格点(i+di, j+dj, k+dk)的梯度下标存在h[di*4 + dj*2 + dk]
+    int h[8];
+    for (int di = 0; di < 2; ++di) {
+        auto px = t.perm_x[(i + di) & 255];
+        for (int dj = 0; dj < 2; ++dj) {
+            auto pxy = px ^ t.perm_y[(j + dj) & 255];
+            h[di * 4 + dj * 2] = pxy ^ t.perm_z[k & 255];
+            h[di * 4 + dj * 2 + 1] = pxy ^ t.perm_z[(k + 1) & 255];
+        }
+    }
+
+    auto uu = u * u * (3 - 2 * u);
+    auto vv = v * v * (3 - 2 * v);
+    auto ww = w * w * (3 - 2 * w);
+
+#if CRAY_HAS_SSE
+    // 转置后每个寄存器存4个格点梯度的同一分量，a为di=0的4个格点，b为di=1
+    __m128 ax = _mm_load_ps(t.gradient[h[0]]);
+    __m128 ay = _mm_load_ps(t.gradient[h[1]]);
+    __m128 az = _mm_load_ps(t.gradient[h[2]]);
+    __m128 aw = _mm_load_ps(t.gradient[h[3]]);
+    _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+    __m128 bx = _mm_load_ps(t.gradient[h[4]]);
+    __m128 by = _mm_load_ps(t.gradient[h[5]]);
+    __m128 bz = _mm_load_ps(t.gradient[h[6]]);
+    __m128 bw = _mm_load_ps(t.gradient[h[7]]);
+    _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+    // 到各格点的偏移，y、z分量按(dj, dk)排列
+    __m128 dy = _mm_setr_ps(v, v, v - 1, v - 1);
+    __m128 dz = _mm_setr_ps(w, w - 1, w, w - 1);
+    __m128 dot_a = _mm_add_ps(
+        _mm_mul_ps(ax, _mm_set1_ps(u)),
+        _mm_add_ps(_mm_mul_ps(ay, dy), _mm_mul_ps(az, dz)));
+    __m128 dot_b = _mm_add_ps(
+        _mm_mul_ps(bx, _mm_set1_ps(u - 1)),
+        _mm_add_ps(_mm_mul_ps(by, dy), _mm_mul_ps(bz, dz)));
+
+    __m128 weight_yz = _mm_setr_ps((1 - vv) * (1 - ww), (1 - vv) * ww,
+                                   vv * (1 - ww), vv * ww);
+    __m128 sum = _mm_mul_ps(
+        weight_yz, _mm_add_ps(_mm_mul_ps(dot_a, _mm_set1_ps(1 - uu)),
+                              _mm_mul_ps(dot_b, _mm_set1_ps(uu))));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    Real accum = 0;
+    for (int c = 0; c < 8; ++c) {
+        int di = c >> 2, dj = (c >> 1) & 1, dk = c & 1;
+        const auto* g = t.gradient[h[c]];
+        auto weight = (di ? uu : 1 - uu) * (dj ? vv : 1 - vv) *
+                      (dk ? ww : 1 - ww);
+        accum += weight * (g[0] * (u - di) + g[1] * (v - dj) +
+                           g[2] * (w - dk));
+    }
+    return accum;
+#endif
+}
+
+Real Perlin::turb(const Point3& p, int depth) const {
+    Real accum = 0;
+    auto temp_p = p;
+    Real weight = 1;
+
+    for (int i = 0; i < depth; i++) {
+        accum += weight * noise(temp_p);
+        weight *= 0.5;
+        temp_p *= 2;
+    }
+
+    return std::fabs(accum);
+}
+
+}  // namespace cray
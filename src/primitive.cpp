@@ -0,0 +1,30 @@
+#include "primitive.h"
+#include "hittable_list.h"
+
+namespace cray {
+
+void PrimitiveStore::add(const std::shared_ptr<Hittable>& obj,
+                         std::vector<PrimitiveRef>& refs) {
+    auto p = obj.get();
+    if (auto list = dynamic_cast<const HittableList*>(p)) {
+        for (const auto& child : list->objects) add(child, refs);
+    } else if (auto sphere = dynamic_cast<const Sphere*>(p)) {
+        refs.push_back(
+            {PrimitiveType::Sphere, static_cast<uint32_t>(spheres_.size())});
+        spheres_.push_back(*sphere);
+    } else if (auto quad = dynamic_cast<const Quad*>(p)) {
+        refs.push_back(
+            {PrimitiveType::Quad, static_cast<uint32_t>(quads_.size())});
+        quads_.push_back(*quad);
+    } else if (auto b = dynamic_cast<const Box*>(p)) {
+        refs.push_back(
+            {PrimitiveType::Box, static_cast<uint32_t>(boxes_.size())});
+        boxes_.push_back(*b);
+    } else {
+        refs.push_back(
+            {PrimitiveType::Hittable, static_cast<uint32_t>(others_.size())});
+        others_.push_back(obj);
+    }
+}
+
+}  // namespace cray
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "shapes.h"
+
+namespace cray {
+
+enum class PrimitiveType : uint8_t {
+    Sphere,
+    Quad,
+    Box,
+    Hittable,  // 其他类型，仍通过虚函数求交
+};
+
+struct PrimitiveRef {
+    PrimitiveType type;
+    uint32_t index;
+};
+
+// 按具体类型分组、按值连续存放的图元。BVH叶节点只保存(type, index)，
+// 求交时用switch直接调用具体类型的hit，省去虚函数调用和shared_ptr的间接访问
+class PrimitiveStore {
+public:
+    // 加入一个物体，HittableList会被展开，生成的引用追加到refs
+    void add(const std::shared_ptr<Hittable>& obj,
+             std::vector<PrimitiveRef>& refs);
+
+    bool hit(PrimitiveRef ref, const Ray& ray, const Interval& interval,
+             HitRecord& rec) const {
+        switch (ref.type) {
+            case PrimitiveType::Sphere:
+                return spheres_[ref.index].hit(ray, interval, rec);
+            case PrimitiveType::Quad:
+                return quads_[ref.index].hit(ray, interval, rec);
+            case PrimitiveType::Box:
+                return boxes_[ref.index].hit(ray, interval, rec);
+            default: return others_[ref.index]->hit(ray, interval, rec);
+        }
+    }
+
+    AABB bounding_box(PrimitiveRef ref) const {
+        switch (ref.type) {
+            case PrimitiveType::Sphere:
+                return spheres_[ref.index].bounding_box();
+            case PrimitiveType::Quad: return quads_[ref.index].bounding_box();
+            case PrimitiveType::Box: return boxes_[ref.index].bounding_box();
+            default: return others_[ref.index]->bounding_box();
+        }
+    }
+
+    // time时刻的包围盒，不支持运动的类型返回整个运动范围的包围盒
+    AABB bounding_box_at(PrimitiveRef ref, Real time) const {
+        if (ref.type == PrimitiveType::Sphere)
+            return spheres_[ref.index].bounding_box_at(time);
+        return bounding_box(ref);
+    }
+
+    // 动画时可以直接修改图元，之后需要更新引用它们的BVH
+    std::vector<Sphere>& spheres() { return spheres_; }
+    std::vector<Quad>& quads() { return quads_; }
+
+    size_t memory_bytes() const {
+        return spheres_.capacity() * sizeof(Sphere) +
+               quads_.capacity() * sizeof(Quad) +
+               boxes_.capacity() * sizeof(Box) +
+               others_.capacity() * sizeof(std::shared_ptr<Hittable>);
+    }
+
+private:
+    std::vector<Sphere> spheres_;
+    std::vector<Quad> quads_;
+    std::vector<Box> boxes_;
+    std::vector<std::shared_ptr<Hittable>> others_;
+};
+
+}  // namespace cray
@@ -7,17 +7,23 @@ namespace cray {
 struct Ray {
     Ray() {}
     Ray(const Point3& o, const Vec3& d) : origin(o), dir(d), tm(0) {}
-    Ray(const Point3& o, const Vec3& d, double time)
+    Ray(const Point3& o, const Vec3& d, Real time)
         : origin(o),
           dir(d),
           tm(time) {}
 
-    Point3 at(double t) const { return origin + dir * t; }
+    Point3 at(Real t) const { return origin + dir * t; }
 
     Point3 origin;
     Vec3 dir;
 
-    double tm;  // 动画帧的时间
+    Real tm;  // 动画帧的时间
+
+    // 光线微分：偏移到相邻像素(x+1、y+1)的两条辅助光线，
+    // 用于估计交点处一个像素覆盖的范围
+    bool has_differentials = false;
+    Point3 rx_origin, ry_origin;
+    Vec3 rx_dir, ry_dir;
 };
 
 }  // namespace cray
\ No newline at end of file
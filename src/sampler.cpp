@@ -0,0 +1,318 @@
+#include "sampler.h"
+#include <algorithm>
+#include <random>
+
+namespace cray {
+
+namespace {
+
+const double OneMinusEpsilon = 0x1.fffffffffffffp-1;
+
+uint32_t hash(uint64_t a, uint64_t b, uint64_t c, uint64_t d = 0) {
+    return static_cast<uint32_t>(hash_values(a, b, c, d));
+}
+
+double to_unit(uint32_t x) { return std::min(x * 0x1p-32, OneMinusEpsilon); }
+
+uint32_t reverse_bits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// Sobol序列第二维，第一维就是reverse_bits
+uint32_t sobol_dim1(uint32_t index) {
+    uint32_t r = 0;
+    for (uint32_t v = 0x80000000u; index != 0; index >>= 1, v ^= v >> 1) {
+        if (index & 1) r ^= v;
+    }
+    return r;
+}
+
+// Owen scramble的哈希实现 (Burley 2020)
+uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+// [0, n)上由seed决定的随机排列的第i个元素 (Kensler 2013)
+uint32_t permutation_element(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+// void-and-cluster生成的环绕blue noise阈值图 (Ulichney 1993)
+class BlueNoiseMask {
+public:
+    static const int Size = 64;
+
+    BlueNoiseMask() : values_(N) {
+        for (int y = 0; y < Size; ++y) {
+            for (int x = 0; x < Size; ++x) {
+                int dx = std::min(x, Size - x);
+                int dy = std::min(y, Size - y);
+                kernel_[y * Size + x] =
+                    exp(-(dx * dx + dy * dy) / (2.0 * 1.5 * 1.5));
+            }
+        }
+
+        bits_.assign(N, 0);
+        energy_.assign(N, 0.0);
+
+        // 初始图案：约10%的随机点，反复把最密集处的点移到最大空洞
+        std::mt19937 rng(0);
+        int ones = N / 10;
+        for (int n = 0; n < ones;) {
+            int p = rng() % N;
+            if (bits_[p]) continue;
+            toggle(p);
+            n++;
+        }
+        while (true) {
+            int cluster = tightest_cluster();
+            toggle(cluster);
+            int void_p = largest_void();
+            toggle(void_p);
+            if (void_p == cluster) break;
+        }
+
+        auto proto_bits = bits_;
+        auto proto_energy = energy_;
+        std::vector<int> rank(N);
+
+        for (int r = ones - 1; r >= 0; --r) {
+            int cluster = tightest_cluster();
+            toggle(cluster);
+            rank[cluster] = r;
+        }
+
+        bits_ = proto_bits;
+        energy_ = proto_energy;
+        for (int r = ones; r < N; ++r) {
+            int void_p = largest_void();
+            toggle(void_p);
+            rank[void_p] = r;
+        }
+
+        for (int p = 0; p < N; ++p) values_[p] = (rank[p] + 0.5) / N;
+    }
+
+    double value(int x, int y) const {
+        return values_[(y & (Size - 1)) * Size + (x & (Size - 1))];
+    }
+
+private:
+    static const int N = Size * Size;
+
+    void toggle(int p) {
+        double sign = bits_[p] ? -1.0 : 1.0;
+        bits_[p] = !bits_[p];
+
+        int px = p % Size, py = p / Size;
+        for (int y = 0; y < Size; ++y) {
+            int ky = (y - py + Size) % Size;
+            for (int x = 0; x < Size; ++x) {
+                int kx = (x - px + Size) % Size;
+                energy_[y * Size + x] += sign * kernel_[ky * Size + kx];
+            }
+        }
+    }
+
+    int tightest_cluster() const {
+        int best = -1;
+        for (int p = 0; p < N; ++p) {
+            if (bits_[p] && (best < 0 || energy_[p] > energy_[best])) best = p;
+        }
+        return best;
+    }
+
+    int largest_void() const {
+        int best = -1;
+        for (int p = 0; p < N; ++p) {
+            if (!bits_[p] && (best < 0 || energy_[p] < energy_[best]))
+                best = p;
+        }
+        return best;
+    }
+
+    double kernel_[N];
+    std::vector<char> bits_;
+    std::vector<double> energy_;
+    std::vector<double> values_;
+};
+
+const BlueNoiseMask& blue_noise_mask() {
+    static const BlueNoiseMask mask;
+    return mask;
+}
+
+}  // namespace
+
+std::unique_ptr<Sampler> create_sampler(SamplerType type,
+                                        int samples_per_pixel, uint32_t seed) {
+    switch (type) {
+        case SamplerType::Stratified:
+            return std::make_unique<StratifiedSampler>(samples_per_pixel,
+                                                       seed);
+        case SamplerType::Sobol: return std::make_unique<SobolSampler>(seed);
+        case SamplerType::BlueNoise:
+            return std::make_unique<BlueNoiseSampler>(seed);
+        default: return std::make_unique<IndependentSampler>(seed);
+    }
+}
+
+bool parse_sampler_type(const std::string& name, SamplerType& type) {
+    static const std::pair<const char*, SamplerType> names[] = {
+        {"independent", SamplerType::Independent},
+        {"stratified", SamplerType::Stratified},
+        {"sobol", SamplerType::Sobol},
+        {"bluenoise", SamplerType::BlueNoise}};
+    for (const auto& [n, t] : names) {
+        if (name == n) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+double IndependentSampler::get_1d() {
+    auto h = hash_values(seed_, px_, py_, sample_index_, dimension_++);
+    return (h >> 11) * 0x1p-53;
+}
+
+Point2 IndependentSampler::get_2d() {
+    auto x = get_1d();
+    return Point2{x, get_1d()};
+}
+
+StratifiedSampler::StratifiedSampler(int samples_per_pixel, uint32_t seed)
+    : Sampler(seed),
+      samples_per_pixel_(std::max(1, samples_per_pixel)) {
+    x_strata_ = std::max(1, static_cast<int>(sqrt(samples_per_pixel_)));
+    y_strata_ = (samples_per_pixel_ + x_strata_ - 1) / x_strata_;
+}
+
+double StratifiedSampler::get_1d() {
+    auto seed = hash(px_, py_, dimension_++, seed_);
+    auto stratum = permutation_element(sample_index_ % samples_per_pixel_,
+                                       samples_per_pixel_, seed);
+    auto jitter = to_unit(hash(seed, sample_index_, 0));
+    return (stratum + jitter) / samples_per_pixel_;
+}
+
+Point2 StratifiedSampler::get_2d() {
+    auto seed = hash(px_, py_, dimension_, seed_);
+    dimension_ += 2;
+
+    uint32_t n = x_strata_ * y_strata_;
+    auto stratum = permutation_element(sample_index_ % n, n, seed);
+    auto x = (stratum % x_strata_ + to_unit(hash(seed, sample_index_, 0))) /
+             x_strata_;
+    auto y = (stratum / x_strata_ + to_unit(hash(seed, sample_index_, 1))) /
+             y_strata_;
+    return Point2{x, y};
+}
+
+double SobolSampler::get_1d() {
+    auto seed = hash(px_, py_, dimension_++, seed_);
+    auto index = nested_uniform_scramble(sample_index_, seed);
+    return to_unit(nested_uniform_scramble(reverse_bits(index),
+                                           hash(seed, 1, 0)));
+}
+
+Point2 SobolSampler::get_2d() {
+    auto seed = hash(px_, py_, dimension_, seed_);
+    dimension_ += 2;
+
+    auto index = nested_uniform_scramble(sample_index_, seed);
+    auto x = nested_uniform_scramble(reverse_bits(index), hash(seed, 1, 0));
+    auto y = nested_uniform_scramble(sobol_dim1(index), hash(seed, 2, 0));
+    return Point2{to_unit(x), to_unit(y)};
+}
+
+double BlueNoiseSampler::offset(int dimension) const {
+    auto h = hash(dimension, 0, seed_);
+    int dx = h & (BlueNoiseMask::Size - 1);
+    int dy = (h >> 8) & (BlueNoiseMask::Size - 1);
+    return blue_noise_mask().value(px_ + dx, py_ + dy);
+}
+
+double BlueNoiseSampler::get_1d() {
+    int dim = dimension_++;
+    auto x = to_unit(nested_uniform_scramble(reverse_bits(sample_index_),
+                                             hash(dim, 1, seed_)));
+    x += offset(dim);
+    return x < 1 ? x : x - 1;
+}
+
+Point2 BlueNoiseSampler::get_2d() {
+    int dim = dimension_;
+    dimension_ += 2;
+
+    auto index = static_cast<uint32_t>(sample_index_);
+    auto x = to_unit(
+        nested_uniform_scramble(reverse_bits(index), hash(dim, 1, seed_)));
+    auto y = to_unit(
+        nested_uniform_scramble(sobol_dim1(index), hash(dim, 2, seed_)));
+    x += offset(dim);
+    y += offset(dim + 1);
+    return Point2{x < 1 ? x : x - 1, y < 1 ? y : y - 1};
+}
+
+Vec3 sample_unit_disk(const Point2& u) {
+    auto ox = 2 * u.x - 1;
+    auto oy = 2 * u.y - 1;
+    if (ox == 0 && oy == 0) return Vec3(0, 0, 0);
+
+    double r, theta;
+    if (fabs(ox) > fabs(oy)) {
+        r = ox;
+        theta = PI / 4 * (oy / ox);
+    } else {
+        r = oy;
+        theta = PI / 2 - PI / 4 * (ox / oy);
+    }
+    return Vec3(r * cos(theta), r * sin(theta), 0);
+}
+
+Vec3 sample_unit_vector(const Point2& u) {
+    auto z = 1 - 2 * u.x;
+    auto r = sqrt(fmax(0.0, 1 - z * z));
+    auto phi = 2 * PI * u.y;
+    return Vec3(r * cos(phi), r * sin(phi), z);
+}
+
+}  // namespace cray
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cgmath.h"
+
+namespace cray {
+
+struct Point2 {
+    double x, y;
+};
+
+// 像素采样器。相机在每个像素采样开始时调用start_pixel_sample，
+// 路径上每个顶点开始时调用start_vertex，之后依次取1D/2D样本
+class Sampler {
+public:
+    // 相机使用的维度：像素内偏移(2)、光圈(2)、时间(1)
+    static const int CameraDimensions = 5;
+    // 每个路径顶点预留的维度，顶点实际少用的维度不会影响后续顶点
+    static const int VertexDimensions = 4;
+
+    Sampler(uint32_t seed) : seed_(seed) {}
+    virtual ~Sampler() = default;
+
+    // 同时把当前线程的random_double流设置到这个像素采样上，
+    // 任意一个像素采样都可以单独重新计算
+    virtual void start_pixel_sample(int i, int j, int sample_index) {
+        px_ = i;
+        py_ = j;
+        sample_index_ = sample_index;
+        dimension_ = 0;
+        seed_random_stream(hash_values(seed_, i, j, sample_index));
+    }
+
+    void start_vertex(int vertex) {
+        dimension_ = CameraDimensions + vertex * VertexDimensions;
+    }
+
+    virtual double get_1d() = 0;
+    virtual Point2 get_2d() = 0;
+
+protected:
+    uint32_t seed_;
+    int px_ = 0, py_ = 0;
+    int sample_index_ = 0;
+    int dimension_ = 0;
+};
+
+enum class SamplerType {
+    Independent,
+    Stratified,
+    Sobol,
+    BlueNoise,
+};
+
+// 所有样本都由(像素, 采样序号, 维度, seed)的哈希得到，与渲染顺序无关
+std::unique_ptr<Sampler> create_sampler(SamplerType type,
+                                        int samples_per_pixel, uint32_t seed);
+
+// 名称为independent/stratified/sobol/bluenoise，无法识别时返回false
+bool parse_sampler_type(const std::string& name, SamplerType& type);
+
+// 独立均匀随机数
+class IndependentSampler : public Sampler {
+public:
+    IndependentSampler(uint32_t seed) : Sampler(seed) {}
+
+    double get_1d() override;
+    Point2 get_2d() override;
+};
+
+// 每个维度按像素内的采样序号分层，层的顺序按(像素, 维度)打乱
+class StratifiedSampler : public Sampler {
+public:
+    StratifiedSampler(int samples_per_pixel, uint32_t seed);
+
+    double get_1d() override;
+    Point2 get_2d() override;
+
+private:
+    int samples_per_pixel_;
+    int x_strata_, y_strata_;
+};
+
+// Owen scrambled Sobol (0,2)序列，每个1D/2D维度使用独立的
+// 序号打乱与scramble(padding)，任意维度都可用
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(uint32_t seed) : Sampler(seed) {}
+
+    double get_1d() override;
+    Point2 get_2d() override;
+};
+
+// 所有像素共用同一组scrambled Sobol点，再按blue noise掩码
+// 对每个像素做Cranley-Patterson平移，误差在屏幕空间上呈blue noise分布
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler(uint32_t seed) : Sampler(seed) {}
+
+    double get_1d() override;
+    Point2 get_2d() override;
+
+private:
+    double offset(int dimension) const;
+};
+
+// 单位圆盘上的均匀分布(同心映射)
+Vec3 sample_unit_disk(const Point2& u);
+// 单位球面上的均匀分布
+Vec3 sample_unit_vector(const Point2& u);
+
+}  // namespace cray
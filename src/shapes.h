@@ -4,10 +4,14 @@
 
 namespace cray {
 
-class Sphere : public Hittable {
+// 从笛卡尔坐标系->极坐标
+void get_sphere_uv(const Vec3& p, Real& u, Real& v);
+
+// 图元的求交定义在头文件中，按具体类型调用时可以内联
+class Sphere final : public Hittable {
 public:
     // 静态球体
-    Sphere(Point3 _center, double _radius, std::shared_ptr<Material> _mat)
+    Sphere(Point3 _center, Real _radius, std::shared_ptr<Material> _mat)
         : center(_center),
           radius(_radius),
           mat(_mat),
@@ -17,7 +21,7 @@ public:
     }
 
     // 动态球体
-    Sphere(Point3 _center, Point3 move_target, double _radius,
+    Sphere(Point3 _center, Point3 move_target, Real _radius,
            std::shared_ptr<Material> _mat)
         : center(_center),
           radius(_radius),
@@ -31,7 +35,21 @@ public:
         aabb = AABB(box0, box1);
     }
 
-    Vec3 get_cur_center(double time) const { return center + time * move_vec; }
+    Vec3 get_cur_center(Real time) const { return center + time * move_vec; }
+
+    // time时刻的包围盒，球沿直线运动，在两个端点之间线性插值仍能包住球
+    AABB bounding_box_at(Real time) const {
+        auto c = is_moving ? get_cur_center(time) : center;
+        auto space = Vec3(radius, radius, radius);
+        return AABB(c - space, c + space);
+    }
+
+    // 移动静止的球(逐帧动画)，同时更新包围盒
+    void move_to(const Point3& c) {
+        center = c;
+        auto space = Vec3(radius, radius, radius);
+        aabb = AABB(center - space, center + space);
+    }
 
     bool hit(const Ray& ray, const Interval& interval,
              HitRecord& rec) const override;
@@ -39,7 +57,7 @@ public:
     AABB bounding_box() const override { return aabb; }
 
     Point3 center;
-    double radius;
+    Real radius;
     std::shared_ptr<Material> mat;
 
     bool is_moving;
@@ -48,7 +66,7 @@ public:
     AABB aabb;
 };
 
-class Quad : public Hittable {
+class Quad final : public Hittable {
 public:
     Quad(const Point3& _Q, const Vec3& _u, const Vec3& _v,
          std::shared_ptr<Material> m)
@@ -77,8 +95,224 @@ private:
     AABB bbox;
 
     Vec3 normal;
-    double D;
+    Real D;
     Vec3 W;
 };
 
+// 轴对齐长方体，一次slab求交代替六个Quad；有朝向的长方体用Instance变换
+class Box final : public Hittable {
+public:
+    Box(const Point3& a, const Point3& b, std::shared_ptr<Material> m)
+        : bbox(AABB(a, b).pad()),
+          mat(m) {}
+
+    AABB bounding_box() const override { return bbox; }
+
+    bool hit(const Ray& ray, const Interval& interval,
+             HitRecord& rec) const override;
+
+private:
+    AABB bbox;
+    std::shared_ptr<Material> mat;
+};
+
+// 无限大平面，代替用巨大的球模拟地面；不放入BVH层次，单独求交
+class Plane final : public Hittable {
+public:
+    Plane(const Point3& p, const Vec3& n, std::shared_ptr<Material> m)
+        : origin(p),
+          normal(unit_vector(n)),
+          mat(m) {
+        // 平面内两个正交的切向量，用于计算UV
+        auto a = std::fabs(normal.x) > 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+        tangent = unit_vector(cross(a, normal));
+        bitangent = cross(normal, tangent);
+    }
+
+    AABB bounding_box() const override {
+        return AABB(Interval::universe, Interval::universe,
+                    Interval::universe);
+    }
+
+    bool is_bounded() const override { return false; }
+
+    bool hit(const Ray& ray, const Interval& interval,
+             HitRecord& rec) const override {
+        auto denom = dot(normal, ray.dir);
+        if (std::fabs(denom) < 1e-8) return false;
+
+        auto t = dot(normal, origin - ray.origin) / denom;
+        if (!interval.contains(t)) return false;
+
+        rec.t = t;
+        rec.p = ray.at(t);
+        rec.mat = mat;
+        rec.set_front_normal(ray, normal);
+
+        // 纹理每个单位长度重复一次
+        auto d = rec.p - origin;
+        auto u = dot(d, tangent), v = dot(d, bitangent);
+        rec.u = u - std::floor(u);
+        rec.v = v - std::floor(v);
+        rec.dpdu = tangent;
+        rec.dpdv = bitangent;
+        rec.dndu = rec.dndv = Vec3(0, 0, 0);
+
+        return true;
+    }
+
+private:
+    Point3 origin;
+    Vec3 normal;
+    Vec3 tangent, bitangent;
+    std::shared_ptr<Material> mat;
+};
+
+inline bool Sphere::hit(const Ray& ray, const Interval& interval,
+                        HitRecord& rec) const {
+    // 光线方程o+t*d带入球方程p*p - r*r=0
+    Point3 cur_center = is_moving ? get_cur_center(ray.tm) : center;
+    Vec3 oc = ray.origin - cur_center;
+    auto a = ray.dir.length_sq();
+    auto half_b = dot(oc, ray.dir);
+    auto c = oc.length_sq() - radius * radius;
+
+    // half_b*half_b - a*c在大球上会严重抵消(单精度时尤其明显)，
+    // 改用oc到光线的垂直距离计算判别式，并用稳定的求根公式
+    Vec3 l = oc - (half_b / a) * ray.dir;
+    auto discriminant = a * (radius * radius - l.length_sq());
+    if (discriminant < 0) return false;
+    auto q = -(half_b + std::copysign(std::sqrt(discriminant), half_b));
+
+    auto t0 = c / q, t1 = q / a;
+    if (t0 > t1) std::swap(t0, t1);
+    auto root = t0;
+    if (!interval.surrounds(root)) {
+        root = t1;
+        if (!interval.surrounds(root)) return false;
+    }
+
+    rec.t = root;
+    rec.p = ray.at(rec.t);
+    rec.mat = mat;
+    auto outway_normal = (rec.p - cur_center) / radius;
+    rec.set_front_normal(ray, outway_normal);
+    get_sphere_uv(outway_normal, rec.u, rec.v);
+
+    // 由get_sphere_uv的参数化 n=(-sinθcosφ, -cosθ, sinθsinφ) 求偏导
+    const auto& n = outway_normal;
+    auto sin_theta = std::fmax(std::sqrt(n.x * n.x + n.z * n.z), Real(1e-6));
+    rec.dndu = 2 * PI * Vec3(n.z, 0, -n.x);
+    rec.dndv = PI * Vec3(-n.y * n.x / sin_theta, sin_theta,
+                         -n.y * n.z / sin_theta);
+    rec.dpdu = radius * rec.dndu;
+    rec.dpdv = radius * rec.dndv;
+
+    return true;
+}
+
+inline bool Quad::hit(const Ray& ray, const Interval& interval,
+                      HitRecord& rec) const {
+    auto denom = dot(normal, ray.dir);  // 分母
+    if (std::fabs(denom) < 1e-8) return false;
+
+    auto t = (D - dot(normal, ray.origin)) / denom;
+    if (!interval.contains(t)) return false;
+
+    // 判断交点是否在Quad内部
+    auto intersection = ray.at(t);
+    Vec3 p = intersection - Q;
+    auto alpha = dot(W, cross(p, v));
+    auto beta = dot(W, cross(u, p));
+    if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1) return false;
+    rec.u = alpha;
+    rec.v = beta;
+    rec.dpdu = u;
+    rec.dpdv = v;
+    rec.dndu = rec.dndv = Vec3(0, 0, 0);
+
+    rec.t = t;
+    rec.p = intersection;
+    rec.mat = mat;
+    rec.set_front_normal(ray, normal);
+
+    return true;
+}
+
+inline bool Box::hit(const Ray& ray, const Interval& interval,
+                     HitRecord& rec) const {
+    // 三个slab区间的交集，同时记录进入和离开时所在的面
+    Real t_near = -Infinity, t_far = Infinity;
+    int axis_near = 0, axis_far = 0;
+    for (int n = 0; n < 3; ++n) {
+        // 与slab平行时0*inf会得到NaN：起点在slab外不相交，否则这一轴不限制t
+        if (ray.dir[n] == 0) {
+            if (!bbox.axis(n).contains(ray.origin[n])) return false;
+            continue;
+        }
+        auto inv = 1 / ray.dir[n];
+        auto t0 = (bbox.axis(n).min - ray.origin[n]) * inv;
+        auto t1 = (bbox.axis(n).max - ray.origin[n]) * inv;
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > t_near) {
+            t_near = t0;
+            axis_near = n;
+        }
+        if (t1 < t_far) {
+            t_far = t1;
+            axis_far = n;
+        }
+    }
+    if (t_near > t_far) return false;
+
+    // 光线起点在盒内时取出射点
+    auto t = t_near;
+    auto axis = axis_near;
+    bool exiting = false;
+    if (!interval.surrounds(t)) {
+        t = t_far;
+        axis = axis_far;
+        exiting = true;
+        if (!interval.surrounds(t)) return false;
+    }
+
+    rec.t = t;
+    rec.p = ray.at(t);
+    rec.mat = mat;
+
+    Vec3 outway_normal(0, 0, 0);
+    outway_normal[axis] = (ray.dir[axis] > 0) == exiting ? 1 : -1;
+    rec.set_front_normal(ray, outway_normal);
+
+    // 与六个Quad拼成的盒子保持相同的UV
+    auto local = [&](int n) {
+        return (rec.p[n] - bbox.axis(n).min) / bbox.axis(n).size();
+    };
+    auto edge = [&](int n, Real sign) {
+        Vec3 e(0, 0, 0);
+        e[n] = sign * bbox.axis(n).size();
+        return e;
+    };
+    bool max_face = outway_normal[axis] > 0;
+    if (axis == 0) {
+        rec.u = max_face ? 1 - local(2) : local(2);
+        rec.v = local(1);
+        rec.dpdu = edge(2, max_face ? -1 : 1);
+        rec.dpdv = edge(1, 1);
+    } else if (axis == 1) {
+        rec.u = local(0);
+        rec.v = max_face ? 1 - local(2) : local(2);
+        rec.dpdu = edge(0, 1);
+        rec.dpdv = edge(2, max_face ? -1 : 1);
+    } else {
+        rec.u = max_face ? local(0) : 1 - local(0);
+        rec.v = local(1);
+        rec.dpdu = edge(0, max_face ? 1 : -1);
+        rec.dpdv = edge(1, 1);
+    }
+    rec.dndu = rec.dndv = Vec3(0, 0, 0);
+
+    return true;
+}
+
 }  // namespace cray
\ No newline at end of file
@@ -1,29 +1,210 @@
 #include "texture.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include "interval.h"
 namespace cray {
 
-Color CheckerTex::value(double u, double v, const Point3& p) const {
-    int x_int = static_cast<int>(std::floor(inv_scale * p.x));
-    int y_int = static_cast<int>(std::floor(inv_scale * p.y));
-    int z_int = static_cast<int>(std::floor(inv_scale * p.z));
+static bool checker_is_even(Real inv_scale, const Point3& p) {
+    int x_int = floor_int(inv_scale * p.x);
+    int y_int = floor_int(inv_scale * p.y);
+    int z_int = floor_int(inv_scale * p.z);
+    return (x_int + y_int + z_int) % 2 == 0;
+}
 
-    bool is_even = (x_int + y_int + z_int) % 2 == 0;
+Color CheckerTex::value(Real u, Real v, const Point3& p) const {
+    bool is_even = checker_is_even(inv_scale, p);
     return is_even ? even->value(u, v, p) : odd->value(u, v, p);
 }
 
-Color ImageTex::value(double u, double v, const Point3& p) const {
-    if (image.invalid()) return Color(0, 1, 1);
+Color CheckerTex::filtered_value(Real u, Real v, const Point3& p,
+                                 const TexFootprint& footprint) const {
+    bool is_even = checker_is_even(inv_scale, p);
+    return is_even ? even->filtered_value(u, v, p, footprint)
+                   : odd->filtered_value(u, v, p, footprint);
+}
+
+Color ImageTex::value(Real u, Real v, const Point3& p) const {
+    const auto& m = mip();
+    if (m.empty()) return Color(0, 1, 1);
+
+    u = Interval(0, 1).clamp(u);
+    v = 1.0 - Interval(0, 1).clamp(v);
+    return m.nearest(u, v);
+}
+
+Color ImageTex::filtered_value(Real u, Real v, const Point3& p,
+                               const TexFootprint& footprint) const {
+    const auto& m = mip();
+    if (m.empty()) return Color(0, 1, 1);
 
+    // 图像的行自上而下，v方向翻转
     u = Interval(0, 1).clamp(u);
     v = 1.0 - Interval(0, 1).clamp(v);
 
-    auto i = static_cast<int>(u * image.width());
-    auto j = static_cast<int>(v * image.height());
-    auto pixel = image.pixel_data(i, j);
+    // 足迹的轴是到相邻像素的偏移，滤波半径取其一半
+    const auto& f = footprint;
+    switch (filter) {
+        case TexFilter::Nearest: return m.nearest(u, v);
+        case TexFilter::Trilinear: {
+            auto du = std::fmax(std::fabs(f.dudx), std::fabs(f.dudy));
+            auto dv = std::fmax(std::fabs(f.dvdx), std::fabs(f.dvdy));
+            return m.trilinear(u, v, std::fmax(du, dv) / 2);
+        }
+        default:
+            return m.ewa(u, v, f.dudx / 2, -f.dvdx / 2, f.dudy / 2,
+                           -f.dvdy / 2);
+    }
+}
+
+BakedTex::BakedTex(std::shared_ptr<Texture> source_, const AABB& bounds_,
+                   Real spacing)
+    : source(std::move(source_)),
+      bounds(AABB(bounds_).pad()) {
+    auto count = [&](const Interval& axis) {
+        auto n = static_cast<int>(std::ceil(axis.size() / spacing)) + 1;
+        return std::max(2, n);
+    };
+    nx = count(bounds.x);
+    ny = count(bounds.y);
+    nz = count(bounds.z);
+    inv_spacing = Vec3((nx - 1) / bounds.x.size(), (ny - 1) / bounds.y.size(),
+                       (nz - 1) / bounds.z.size());
+
+    // 按z层分给各线程，纹理查询是只读的
+    grid.resize(3 * static_cast<size_t>(nx) * ny * nz);
+    std::atomic<int> next_z(0);
+    auto worker = [&]() {
+        for (int z = next_z++; z < nz; z = next_z++) {
+            for (int y = 0; y < ny; ++y) {
+                for (int x = 0; x < nx; ++x) {
+                    Point3 p(bounds.x.min + x / inv_spacing.x,
+                             bounds.y.min + y / inv_spacing.y,
+                             bounds.z.min + z / inv_spacing.z);
+                    auto c = source->value(0, 0, p);
+                    auto cell =
+                        3 * ((static_cast<size_t>(z) * ny + y) * nx + x);
+                    for (int n = 0; n < 3; ++n)
+                        grid[cell + n] = static_cast<float>(c[n]);
+                }
+            }
+        }
+    };
+    int thread_count = std::max(
+        1, std::min(static_cast<int>(std::thread::hardware_concurrency()), nz));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < thread_count; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+Color BakedTex::value(Real u, Real v, const Point3& p) const {
+    auto gx = (p.x - bounds.x.min) * inv_spacing.x;
+    auto gy = (p.y - bounds.y.min) * inv_spacing.y;
+    auto gz = (p.z - bounds.z.min) * inv_spacing.z;
+    if (!(gx >= 0 && gx <= nx - 1 && gy >= 0 && gy <= ny - 1 && gz >= 0 &&
+          gz <= nz - 1))
+        return source->value(u, v, p);
+
+    int ix = std::min(static_cast<int>(gx), nx - 2);
+    int iy = std::min(static_cast<int>(gy), ny - 2);
+    int iz = std::min(static_cast<int>(gz), nz - 2);
+    Real fx = gx - ix, fy = gy - iy, fz = gz - iz;
+
+    size_t stride_y = 3 * static_cast<size_t>(nx);
+    size_t stride_z = stride_y * ny;
+    const float* base =
+        &grid[iz * stride_z + iy * stride_y + 3 * static_cast<size_t>(ix)];
+    Real c[3];
+    for (int n = 0; n < 3; ++n) {
+        auto lerp_x = [&](const float* row) {
+            return row[n] + fx * (row[3 + n] - row[n]);
+        };
+        auto c0 = lerp_x(base) + fy * (lerp_x(base + stride_y) - lerp_x(base));
+        auto z1 = base + stride_z;
+        auto c1 = lerp_x(z1) + fy * (lerp_x(z1 + stride_y) - lerp_x(z1));
+        c[n] = c0 + fz * (c1 - c0);
+    }
+    return Color(c[0], c[1], c[2]);
+}
+
+BakedTex::ErrorReport BakedTex::measure_error(int samples) const {
+    // 用哈希生成采样点，不占用场景的随机数序列
+    auto unit = [](uint64_t h) { return (h >> 11) * 0x1p-53; };
+    ErrorReport report;
+    double sum_sq = 0;
+    for (int i = 0; i < samples; ++i) {
+        Point3 p(bounds.x.min + bounds.x.size() * unit(hash_values(i, 0)),
+                 bounds.y.min + bounds.y.size() * unit(hash_values(i, 1)),
+                 bounds.z.min + bounds.z.size() * unit(hash_values(i, 2)));
+        auto d = value(0, 0, p) - source->value(0, 0, p);
+        auto err = std::fmax(std::fabs(d.x),
+                             std::fmax(std::fabs(d.y), std::fabs(d.z)));
+        report.max_error = std::fmax(report.max_error, err);
+        sum_sq += err * err;
+    }
+    report.samples = samples;
+    if (samples > 0) report.rms_error = std::sqrt(sum_sq / samples);
+    return report;
+}
+
+CompiledTex::CompiledTex(std::shared_ptr<Texture> tex) {
+    if (auto solid = dynamic_cast<const SolidColorTex*>(tex.get())) {
+        constant_ = solid->color_val;
+        return;
+    }
+    compile(tex);
+}
+
+uint32_t CompiledTex::compile(const std::shared_ptr<Texture>& tex) {
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    Node node;
+    if (auto solid = dynamic_cast<const SolidColorTex*>(tex.get())) {
+        node.color = solid->color_val;
+    } else if (auto checker = dynamic_cast<const CheckerTex*>(tex.get())) {
+        node.inv_scale = checker->inv_scale;
+        auto even = dynamic_cast<const SolidColorTex*>(checker->even.get());
+        auto odd = dynamic_cast<const SolidColorTex*>(checker->odd.get());
+        if (even && odd) {
+            // 两种颜色都是常量时存在同一个节点里
+            node.kind = Node::ConstantChecker;
+            node.color = even->color_val;
+            node.odd_color = odd->color_val;
+        } else {
+            node.kind = Node::Checker;
+            node.even = compile(checker->even);
+            node.odd = compile(checker->odd);
+        }
+    } else {
+        node.kind = Node::Leaf;
+        node.leaf = tex.get();
+        leaves_.push_back(tex);
+    }
+    nodes_[index] = node;
+    return index;
+}
 
-    const auto color_scale = 1.0 / 255.0;
-    return Color(color_scale * pixel[0], color_scale * pixel[1],
-                 color_scale * pixel[2]);
+Color CompiledTex::evaluate(Real u, Real v, const Point3& p,
+                            const TexFootprint* footprint) const {
+    const Node* node = nodes_.data();
+    while (true) {
+        switch (node->kind) {
+            case Node::Constant: return node->color;
+            case Node::ConstantChecker:
+                return checker_is_even(node->inv_scale, p) ? node->color
+                                                           : node->odd_color;
+            case Node::Checker:
+                node = &nodes_[checker_is_even(node->inv_scale, p) ? node->even
+                                                                   : node->odd];
+                break;
+            default:
+                return footprint
+                           ? node->leaf->filtered_value(u, v, p, *footprint)
+                           : node->leaf->value(u, v, p);
+        }
+    }
 }
 
 }  // namespace cray
\ No newline at end of file
@@ -1,21 +1,37 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "aabb.h"
 #include "cgmath.h"
-#include "cray_image.h"
+#include "image_registry.h"
 #include "perlin.h"
 
 namespace cray {
 
+// 一次纹理查询在UV空间中的足迹：像素在纹理上覆盖范围的两条轴
+struct TexFootprint {
+    Real dudx = 0, dvdx = 0;
+    Real dudy = 0, dvdy = 0;
+};
+
 struct Texture {
     virtual ~Texture() = default;
-    virtual Color value(double u, double v, const Point3& p) const = 0;
+    virtual Color value(Real u, Real v, const Point3& p) const = 0;
+
+    // 带足迹的查询，可滤波的纹理据此选择细节层级，默认忽略足迹
+    virtual Color filtered_value(Real u, Real v, const Point3& p,
+                                 const TexFootprint& footprint) const {
+        return value(u, v, p);
+    }
 };
 
 struct SolidColorTex : public Texture {
     SolidColorTex(Color c) : color_val(c) {}
-    SolidColorTex(double r, double g, double b) : color_val(Color(r, g, b)) {}
+    SolidColorTex(Real r, Real g, Real b) : color_val(Color(r, g, b)) {}
 
-    Color value(double u, double v, const Point3& p) const override {
+    Color value(Real u, Real v, const Point3& p) const override {
         return color_val;
     }
 
@@ -23,44 +39,138 @@ struct SolidColorTex : public Texture {
 };
 
 struct CheckerTex : public Texture {
-    CheckerTex(double scale, std::shared_ptr<Texture> _even,
+    CheckerTex(Real scale, std::shared_ptr<Texture> _even,
                std::shared_ptr<Texture> _odd)
         : inv_scale(1.0 / scale),
           even(_even),
           odd(_odd) {}
-    CheckerTex(double scale, Color c0, Color c1)
+    CheckerTex(Real scale, Color c0, Color c1)
         : inv_scale(1.0 / scale),
           even(std::make_shared<SolidColorTex>(c0)),
           odd(std::make_shared<SolidColorTex>(c1)) {}
 
-    Color value(double u, double v, const Point3& p) const override;
+    Color value(Real u, Real v, const Point3& p) const override;
+    Color filtered_value(Real u, Real v, const Point3& p,
+                         const TexFootprint& footprint) const override;
 
-    double inv_scale;
+    Real inv_scale;
     std::shared_ptr<Texture> even;
     std::shared_ptr<Texture> odd;
 };
 
+enum class TexFilter {
+    Nearest,
+    Trilinear,
+    EWA,
+};
+
+// 图像纹理，mip金字塔由ImageRegistry在后台或第一次查询时解码，
+// 多个纹理共享同一张图像。
+// value()为最近邻查询，filtered_value()按足迹和filter在金字塔上滤波
 struct ImageTex : public Texture {
-    ImageTex(const std::string& path) : image(path) {}
+    ImageTex(const std::string& path, TexFilter f = TexFilter::EWA,
+             TexFormat format = TexFormat::Auto)
+        : image(image_registry().load(path, format)),
+          filter(f) {}
+
+    Color value(Real u, Real v, const Point3& p) const override;
+    Color filtered_value(Real u, Real v, const Point3& p,
+                         const TexFootprint& footprint) const override;
+
+    // 解码未完成时等待，延迟加载时由第一次查询解码。
+    // 之后直接使用记下的指针，不再经过future
+    const MipMap& mip() const {
+        auto m = loaded.load(std::memory_order_acquire);
+        if (!m) {
+            m = image.get().get();
+            loaded.store(m, std::memory_order_release);
+        }
+        return *m;
+    }
 
-    Color value(double u, double v, const Point3& p) const override;
+    ImageRegistry::Handle image;
+    TexFilter filter;
+    mutable std::atomic<const MipMap*> loaded{nullptr};
+};
 
-    CRayImage image;
+// 把只与位置p有关的实体纹理在bounds内按间距spacing采样成三维网格，
+// 查询时三线性插值，bounds之外仍查询原纹理。
+// 很薄的bounds(如平面上的一块区域)只有两层网格点，相当于二维烘焙
+struct BakedTex : public Texture {
+    BakedTex(std::shared_ptr<Texture> source, const AABB& bounds,
+             Real spacing);
+
+    Color value(Real u, Real v, const Point3& p) const override;
+
+    // 在bounds内随机取点与原纹理比较，误差取三个通道中最大的
+    struct ErrorReport {
+        Real max_error = 0;
+        Real rms_error = 0;
+        int samples = 0;
+    };
+    ErrorReport measure_error(int samples) const;
+    size_t memory_bytes() const { return grid.size() * sizeof(float); }
+
+    std::shared_ptr<Texture> source;
+    AABB bounds;
+    int nx, ny, nz;
+    Vec3 inv_spacing;
+    std::vector<float> grid;  // 每个网格点RGB三个float，x变化最快
 };
 
 struct NoiseTex : public Texture {
     NoiseTex() : scale(1.0) {}
-    NoiseTex(double scale_) : scale(scale_) {}
+    NoiseTex(Real scale_) : scale(scale_) {}
 
-    Color value(double u, double v, const Point3& p) const override {
+    Color value(Real u, Real v, const Point3& p) const override {
         // return Color(1, 1, 1) * 0.5 * (1.0 + perlin.noise(scale * p));
 
         auto s = scale * p;
-        return Color(1, 1, 1) * 0.5 * (1 + sin(s.z + 10 * perlin.turb(s)));
+        return Color(1, 1, 1) * 0.5 *
+               (1 + std::sin(s.z + 10 * perlin.turb(s)));
     }
 
     Perlin perlin;
-    double scale;
+    Real scale;
+};
+
+// 材质中使用的纹理。构造时展开纹理树：常量颜色直接存在对象里，
+// 棋盘格及其子纹理展开为按下标跳转的节点数组，其他纹理作为叶节点保留虚调用。
+// 展开之后原纹理树的修改不再生效
+class CompiledTex {
+public:
+    explicit CompiledTex(const Color& c) : constant_(c) {}
+    explicit CompiledTex(std::shared_ptr<Texture> tex);
+
+    bool is_constant() const { return nodes_.empty(); }
+
+    Color value(Real u, Real v, const Point3& p) const {
+        if (nodes_.empty()) return constant_;
+        return evaluate(u, v, p, nullptr);
+    }
+    Color filtered_value(Real u, Real v, const Point3& p,
+                         const TexFootprint& footprint) const {
+        if (nodes_.empty()) return constant_;
+        return evaluate(u, v, p, &footprint);
+    }
+
+private:
+    struct Node {
+        enum Kind : uint8_t { Constant, ConstantChecker, Checker, Leaf };
+        Kind kind = Constant;
+        uint32_t even = 0, odd = 0;  // 棋盘格两个子节点的下标
+        Real inv_scale = 0;
+        Color color, odd_color;
+        const Texture* leaf = nullptr;
+    };
+
+    uint32_t compile(const std::shared_ptr<Texture>& tex);
+    Color evaluate(Real u, Real v, const Point3& p,
+                   const TexFootprint* footprint) const;
+
+    Color constant_;
+    std::vector<Node> nodes_;  // 第0个为根节点
+    std::vector<std::shared_ptr<Texture>> leaves_;  // 保持叶节点的纹理有效
 };
 
 }  // namespace cray
\ No newline at end of file
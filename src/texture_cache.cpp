@@ -0,0 +1,68 @@
+#include "texture_cache.h"
+
+namespace cray {
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::find(uint64_t key) {
+    auto& s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.entries.find(key);
+    if (it == s.entries.end()) {
+        s.misses++;
+        return nullptr;
+    }
+    s.hits++;
+    s.lru.splice(s.lru.begin(), s.lru, it->second.lru_pos);
+    return it->second.tile;
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::insert(uint64_t key,
+                                                               Tile tile) {
+    auto& s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.entries.find(key);
+    if (it != s.entries.end()) return it->second.tile;
+
+    auto size = tile.size();
+    auto ptr = std::make_shared<const Tile>(std::move(tile));
+    s.lru.push_front(key);
+    s.entries.emplace(key, Entry{ptr, s.lru.begin()});
+    s.bytes += size;
+    auto total = bytes_ += size;
+
+    // 每个分片各占预算的1/ShardCount，至少保留刚插入的tile。
+    // 被淘汰但仍在使用中的tile由shared_ptr保证有效
+    while (s.bytes > budget_ / ShardCount && s.lru.size() > 1) {
+        auto victim = s.entries.find(s.lru.back());
+        auto victim_size = victim->second.tile->size();
+        s.bytes -= victim_size;
+        bytes_ -= victim_size;
+        s.entries.erase(victim);
+        s.lru.pop_back();
+        s.evictions++;
+    }
+
+    auto peak = peak_bytes_.load();
+    while (total > peak && !peak_bytes_.compare_exchange_weak(peak, total)) {
+    }
+    return ptr;
+}
+
+TextureCache::Stats TextureCache::stats() const {
+    Stats stats;
+    for (const auto& s : shards_) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        stats.hits += s.hits;
+        stats.misses += s.misses;
+        stats.evictions += s.evictions;
+    }
+    stats.bytes = bytes_;
+    stats.peak_bytes = peak_bytes_;
+    return stats;
+}
+
+TextureCache& texture_cache() {
+    static TextureCache cache;
+    return cache;
+}
+
+}  // namespace cray
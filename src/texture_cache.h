@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cray {
+
+// 全局的纹理tile缓存。总内存超过预算时按LRU淘汰，
+// 未命中时由调用方读取tile后insert。按key分片加锁，减少渲染线程间的争用
+class TextureCache {
+public:
+    using Tile = std::vector<unsigned char>;
+
+    // 预算为0时不启用缓存，纹理全部常驻内存
+    void set_budget(size_t bytes) { budget_ = bytes; }
+    size_t budget() const { return budget_; }
+    bool enabled() const { return budget_ > 0; }
+
+    // 每个使用缓存的纹理一个编号，与层级、tile序号一起组成key
+    uint32_t new_texture_id() { return next_id_++; }
+    static uint64_t key(uint32_t texture, int level, uint32_t tile) {
+        return static_cast<uint64_t>(texture) << 40 |
+               static_cast<uint64_t>(level) << 32 | tile;
+    }
+
+    // 未缓存时返回空
+    std::shared_ptr<const Tile> find(uint64_t key);
+    // 若其他线程已经插入了同一个tile，返回已有的
+    std::shared_ptr<const Tile> insert(uint64_t key, Tile tile);
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;
+        size_t peak_bytes = 0;
+    };
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<const Tile> tile;
+        std::list<uint64_t>::iterator lru_pos;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        std::list<uint64_t> lru;  // 最近使用的在前
+        size_t bytes = 0;
+        uint64_t hits = 0, misses = 0, evictions = 0;
+    };
+
+    static const int ShardCount = 16;
+    Shard& shard(uint64_t key) {
+        return shards_[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    }
+
+    Shard shards_[ShardCount];
+    size_t budget_ = 0;
+    std::atomic<uint32_t> next_id_{0};
+    std::atomic<size_t> bytes_{0};
+    std::atomic<size_t> peak_bytes_{0};
+};
+
+TextureCache& texture_cache();
+
+}  // namespace cray
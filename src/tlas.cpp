@@ -0,0 +1,125 @@
+#include "tlas.h"
+#include <algorithm>
+
+namespace cray {
+
+namespace {
+
+Real centroid(const AABB& box, int axis) {
+    return (box.axis(axis).min + box.axis(axis).max) / 2;
+}
+
+}  // namespace
+
+int TopLevelBVH::add(std::shared_ptr<Hittable> blas,
+                     const Transform& transform) {
+    instances_.emplace_back(std::move(blas), transform);
+    return static_cast<int>(instances_.size()) - 1;
+}
+
+void TopLevelBVH::set_transform(int instance, const Transform& transform) {
+    instances_[instance] =
+        Instance(instances_[instance].object(), transform);
+}
+
+void TopLevelBVH::build() {
+    nodes_.clear();
+    order_.clear();
+    unbounded_.clear();
+    for (size_t i = 0; i < instances_.size(); ++i) {
+        if (instances_[i].is_bounded())
+            order_.push_back(static_cast<uint32_t>(i));
+        else
+            unbounded_.push_back(static_cast<uint32_t>(i));
+    }
+
+    if (order_.empty()) {
+        nodes_.push_back(Node{AABB(), 0, 0, true});
+        return;
+    }
+    nodes_.reserve(2 * order_.size());
+    build(0, order_.size());
+}
+
+uint32_t TopLevelBVH::build(size_t begin, size_t end) {
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    AABB bounds, centroids;
+    for (size_t i = begin; i < end; ++i) {
+        auto box = instances_[order_[i]].bounding_box();
+        bounds = AABB(bounds, box);
+        Point3 c(centroid(box, 0), centroid(box, 1), centroid(box, 2));
+        centroids = AABB(centroids, AABB(c, c));
+    }
+
+    if (end - begin <= 2) {
+        nodes_[index] = Node{bounds, static_cast<uint32_t>(begin),
+                             static_cast<uint32_t>(end - begin), true};
+        return index;
+    }
+
+    // 沿实例中心分布最长的轴按中位数划分
+    int axis = 0;
+    for (int n = 1; n < 3; ++n) {
+        if (centroids.axis(n).size() > centroids.axis(axis).size()) axis = n;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(order_.begin() + begin, order_.begin() + mid,
+                     order_.begin() + end, [&](uint32_t a, uint32_t b) {
+                         return centroid(instances_[a].bounding_box(), axis) <
+                                centroid(instances_[b].bounding_box(), axis);
+                     });
+
+    build(begin, mid);
+    auto right = build(mid, end);
+    nodes_[index] = Node{bounds, right, 0, false};
+    return index;
+}
+
+bool TopLevelBVH::hit(const Ray& ray, const Interval& interval,
+                      HitRecord& rec) const {
+    if (nodes_.empty()) return false;
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    Vec3 inv_dir(1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z);
+    bool hit_anything = false;
+    auto closest_so_far = interval.max;
+
+    // 先求交无界实例，得到的交点可以剔除更多节点
+    for (auto i : unbounded_) {
+        if (instances_[i].hit(ray, Interval(interval.min, closest_so_far),
+                              rec)) {
+            hit_anything = true;
+            closest_so_far = rec.t;
+        }
+    }
+
+    while (stack_size > 0) {
+        auto index = stack[--stack_size];
+        const auto& node = nodes_[index];
+        if (!node.aabb.hit(ray, inv_dir,
+                           Interval(interval.min, closest_so_far)))
+            continue;
+
+        if (node.leaf) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (instances_[order_[i]].hit(
+                        ray, Interval(interval.min, closest_so_far), rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+        } else {
+            stack[stack_size++] = node.offset;
+            stack[stack_size++] = index + 1;
+        }
+    }
+
+    return hit_anything;
+}
+
+}  // namespace cray
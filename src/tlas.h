@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "hittable.h"
+
+namespace cray {
+
+// 两层加速结构的顶层。每个实例引用一个底层结构(通常是共享的BVHNode)
+// 和一个仿射变换：底层结构按唯一的几何体构建一次，内存随唯一几何体
+// 而不是实例数增长；移动实例后只需要重建顶层
+class TopLevelBVH : public Hittable {
+public:
+    // 返回实例序号。添加或修改实例后需要调用build
+    int add(std::shared_ptr<Hittable> blas,
+            const Transform& transform = Transform());
+    void set_transform(int instance, const Transform& transform);
+
+    // 按实例包围盒构建顶层BVH，只涉及实例数量级的工作
+    void build();
+
+    bool hit(const Ray& ray, const Interval& interval,
+             HitRecord& rec) const override;
+
+    // 有界实例的包围盒，build之前为空
+    AABB bounding_box() const override {
+        return nodes_.empty() ? AABB() : nodes_[0].aabb;
+    }
+
+    bool is_bounded() const override { return unbounded_.empty(); }
+
+    size_t size() const { return instances_.size(); }
+    const Instance& instance(int i) const { return instances_[i]; }
+
+    // 顶层占用的内存，底层结构另计
+    size_t memory_bytes() const {
+        return sizeof(*this) + instances_.capacity() * sizeof(Instance) +
+               nodes_.capacity() * sizeof(Node) +
+               order_.capacity() * sizeof(uint32_t) +
+               unbounded_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    struct Node {
+        AABB aabb;
+        uint32_t offset;  // 内部节点：右子节点下标；叶节点：order_中的位置
+        uint32_t count;
+        bool leaf;
+    };
+
+    uint32_t build(size_t begin, size_t end);
+
+    std::vector<Instance> instances_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> order_;  // 叶节点引用的实例序号
+    // 无界实例(如平面)的中心不确定，不参与构建，每条光线单独求交
+    std::vector<uint32_t> unbounded_;
+};
+
+}  // namespace cray
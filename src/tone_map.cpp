@@ -0,0 +1,55 @@
+#include "tone_map.h"
+#include <cstring>
+#include "interval.h"
+#include "stb_image_write.h"
+
+namespace cray {
+
+double linear_to_gamma(double linear_comp) { return sqrt(linear_comp); }
+
+uint8_t final_color(double c) {
+    static const Interval cl(0.000, 0.999);
+
+    auto r = linear_to_gamma(c);
+    return static_cast<int>(255.999 * cl.clamp(r));
+}
+
+std::vector<uint8_t> tone_map(const Film& film, ToneMapOp op,
+                              double exposure) {
+    std::vector<uint8_t> pixels(film.width() * film.height() * 3);
+    int index = 0;
+
+    for (int j = 0; j < film.height(); ++j) {
+        for (int i = 0; i < film.width(); ++i) {
+            auto c = exposure * film.pixel(i, j);
+            for (int n = 0; n < 3; ++n) {
+                auto v = c[n];
+                if (op == ToneMapOp::Reinhard) v = v / (1.0 + v);
+                pixels[index + n] = final_color(v);
+            }
+            index += 3;
+        }
+    }
+
+    return pixels;
+}
+
+bool write_png(const std::vector<uint8_t>& pixels, int width, int height,
+               const std::string& path) {
+    return stbi_write_png(path.c_str(), width, height, 3, pixels.data(),
+                          width * 3) != 0;
+}
+
+static bool has_extension(const std::string& path, const char* ext) {
+    auto len = strlen(ext);
+    return path.size() >= len &&
+           path.compare(path.size() - len, len, ext) == 0;
+}
+
+bool save_image(const Film& film, const std::string& path) {
+    if (has_extension(path, ".pfm")) return write_pfm(film, path);
+    if (has_extension(path, ".exr")) return write_exr(film, path);
+    return write_png(tone_map(film), film.width(), film.height(), path);
+}
+
+}  // namespace cray
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "film.h"
+
+namespace cray {
+
+enum class ToneMapOp {
+    Clamp,     // 直接截断到[0,1)
+    Reinhard,  // c / (1 + c)
+};
+
+double linear_to_gamma(double linear_comp);
+
+// 将film的线性radiance映射为8位sRGB(gamma 2)的RGB像素
+std::vector<uint8_t> tone_map(const Film& film,
+                              ToneMapOp op = ToneMapOp::Clamp,
+                              double exposure = 1.0);
+
+bool write_png(const std::vector<uint8_t>& pixels, int width, int height,
+               const std::string& path);
+
+// 根据扩展名(.png/.pfm/.exr)选择输出格式
+bool save_image(const Film& film, const std::string& path);
+
+}  // namespace cray
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cmath>
+#include "aabb.h"
+#include "cgmath.h"
+
+namespace cray {
+
+// 仿射变换，3x4矩阵，第4列为平移
+struct Transform {
+    Transform() : Transform(Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1)) {}
+
+    // 三个基向量(矩阵的列)与平移
+    Transform(const Vec3& c0, const Vec3& c1, const Vec3& c2,
+              const Vec3& offset = Vec3(0, 0, 0)) {
+        for (int i = 0; i < 3; ++i) {
+            m[i][0] = c0[i];
+            m[i][1] = c1[i];
+            m[i][2] = c2[i];
+            m[i][3] = offset[i];
+        }
+    }
+
+    static Transform translate(const Vec3& offset) {
+        return Transform(Vec3(1, 0, 0), Vec3(0, 1, 0), Vec3(0, 0, 1),
+                         offset);
+    }
+
+    static Transform scale(const Vec3& s) {
+        return Transform(Vec3(s.x, 0, 0), Vec3(0, s.y, 0), Vec3(0, 0, s.z));
+    }
+
+    // 绕任意轴旋转，角度单位为度
+    static Transform rotate(const Vec3& axis, Real degrees) {
+        auto a = unit_vector(axis);
+        auto radians = degrees_to_radians(degrees);
+        Real s = std::sin(radians), c = std::cos(radians);
+
+        Transform t;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                t.m[i][j] = a[i] * a[j] * (1 - c) + (i == j ? c : 0);
+            }
+        }
+        t.m[0][1] -= a.z * s;
+        t.m[0][2] += a.y * s;
+        t.m[1][0] += a.z * s;
+        t.m[1][2] -= a.x * s;
+        t.m[2][0] -= a.y * s;
+        t.m[2][1] += a.x * s;
+        return t;
+    }
+
+    static Transform rotate_y(Real degrees) {
+        auto radians = degrees_to_radians(degrees);
+        Real s = std::sin(radians), c = std::cos(radians);
+        return Transform(Vec3(c, 0, -s), Vec3(0, 1, 0), Vec3(s, 0, c));
+    }
+
+    Point3 point(const Point3& p) const {
+        return Point3(row(0, p) + m[0][3], row(1, p) + m[1][3],
+                      row(2, p) + m[2][3]);
+    }
+
+    Vec3 vector(const Vec3& v) const {
+        return Vec3(row(0, v), row(1, v), row(2, v));
+    }
+
+    // 按转置矩阵变换，对逆矩阵调用即得到法线变换
+    Vec3 transposed_vector(const Vec3& v) const {
+        return Vec3(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                    m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                    m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+    }
+
+    // 变换后包围盒的紧致AABB (Arvo 1990)
+    AABB bounds(const AABB& box) const {
+        Interval axes[3];
+        for (int i = 0; i < 3; ++i) {
+            Real lo = m[i][3], hi = m[i][3];
+            for (int j = 0; j < 3; ++j) {
+                auto a = m[i][j] * box.axis(j).min;
+                auto b = m[i][j] * box.axis(j).max;
+                lo += std::fmin(a, b);
+                hi += std::fmax(a, b);
+            }
+            axes[i] = Interval(lo, hi);
+        }
+        return AABB(axes[0], axes[1], axes[2]);
+    }
+
+    Transform inverse() const {
+        // 线性部分用伴随矩阵求逆，平移为-A^-1 * t
+        auto cof = [this](int r0, int r1, int c0, int c1) {
+            return m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+        };
+        Transform inv;
+        inv.m[0][0] = cof(1, 2, 1, 2);
+        inv.m[0][1] = -cof(0, 2, 1, 2);
+        inv.m[0][2] = cof(0, 1, 1, 2);
+        inv.m[1][0] = -cof(1, 2, 0, 2);
+        inv.m[1][1] = cof(0, 2, 0, 2);
+        inv.m[1][2] = -cof(0, 1, 0, 2);
+        inv.m[2][0] = cof(1, 2, 0, 1);
+        inv.m[2][1] = -cof(0, 2, 0, 1);
+        inv.m[2][2] = cof(0, 1, 0, 1);
+
+        auto det = m[0][0] * inv.m[0][0] + m[0][1] * inv.m[1][0] +
+                   m[0][2] * inv.m[2][0];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) inv.m[i][j] /= det;
+        }
+
+        auto t = inv.vector(Vec3(m[0][3], m[1][3], m[2][3]));
+        for (int i = 0; i < 3; ++i) inv.m[i][3] = -t[i];
+        return inv;
+    }
+
+    // 先应用b再应用a
+    friend Transform operator*(const Transform& a, const Transform& b) {
+        Transform t;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                t.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] +
+                            a.m[i][2] * b.m[2][j] + (j == 3 ? a.m[i][3] : 0);
+            }
+        }
+        return t;
+    }
+
+    Real m[3][4];
+
+private:
+    Real row(int i, const Vec3& v) const {
+        return m[i][0] * v.x + m[i][1] * v.y + m[i][2] * v.z;
+    }
+};
+
+}  // namespace cray
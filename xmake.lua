@@ -1,8 +1,20 @@
 add_rules("mode.debug", "mode.release")
 set_languages("c++20")
 
+-- xmake f --float_precision=y 使用单精度(SSE)向量
+option("float_precision")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Use single precision Vec3 for geometry and shading")
+    add_defines("CRAY_FLOAT_PRECISION")
+option_end()
+
 target("cray")
     set_kind("binary")
     add_includedirs("src")
     add_files("src/**.cpp")
     set_rundir("./")
+    add_options("float_precision")
+    if is_plat("linux", "macosx") then
+        add_syslinks("pthread")
+    end